@@ -1,23 +1,46 @@
 // Native methods for the NodeEngine Java class
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <deque>
 #include <exception>
 #include <functional>
+#include <iterator>
+#include <list>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <new>
 #include <queue>
 #include <stdexcept>
 #include <string>
 #include <thread>
+#include <type_traits>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include <jni.h>
 #include <android/log.h>
 
 #include "Log.h"
+#include "CancellationToken.h"
+#include "ThreadOptions.h"
+#include "MpscQueue.h"
+#include "RingQueue.h"
+#include "FairQueue.h"
 #include "AsyncQueue.h"
+#include "UniqueFunction.h"
 #include "WorkItemDispatcher.h"
+#include "NodeValue.h"
 #include "INodeEngine.h"
+#include "ThreadPool.h"
+#include "LruCache.h"
+#include "SlotTable.h"
 #include "JXCoreEngine.h"
 #include "JniUtils.h"
 
@@ -97,6 +120,8 @@ JNIEXPORT void JNICALL Java_io_opent2t_NodeEngine_init(
 {
     LogTrace("init()");
 
+    // No callback thread pool: result callbacks and calls from script reach the Java listeners on
+    // the engine thread, one at a time and in the order the script made them.
     INodeEngine* nodeEngine = new JXCoreEngine();
     setNodeEngine(env, thiz, nodeEngine);
 }
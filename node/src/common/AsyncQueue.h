@@ -25,6 +25,250 @@ public:
     virtual void OnStarted() = 0;
     virtual void OnProcessQueueItem(QueueItem& item) = 0;
     virtual void OnStopped() = 0;
+
+    // Invoked instead of OnProcessQueueItem for an item that was discarded by the
+    // DropOldest overflow policy. Runs on the pushing thread that caused the overflow.
+    virtual void OnDropQueueItem(QueueItem& /*item*/) { }
+
+    // Invoked on the worker thread whenever it runs out of items, so the handler can do
+    // background work of its own between items. Returns how long the worker may then wait for
+    // items before calling OnIdle again, even if items keep arriving; max() means there is no
+    // background work left, and the worker waits for items indefinitely.
+    virtual std::chrono::steady_clock::duration OnIdle()
+    {
+        return std::chrono::steady_clock::duration::max();
+    }
+};
+
+// Selects how producers hand items to an AsyncQueue's worker thread.
+enum class AsyncQueueBackend
+{
+    // Every push takes the queue mutex. Lowest overhead when there are few producers.
+    Locked,
+
+    // Pushes go through a lock-free MPSC inbox that the worker drains; producers only
+    // take the queue mutex to wake a worker that is parked waiting for items.
+    LockFree,
+};
+
+// Selects what a bounded AsyncQueue does with a push that would exceed its capacity.
+enum class AsyncQueueOverflowPolicy
+{
+    // Push returns false and the item is not queued.
+    Reject,
+
+    // Push waits up to the configured timeout for space, then returns false.
+    // Pushes from the worker thread itself never wait; they are rejected instead.
+    Block,
+
+    // The oldest waiting item is removed and passed to IQueueItemHandler::OnDropQueueItem.
+    DropOldest,
+};
+
+// Selects how an AsyncQueue's worker thread waits when it runs out of items.
+enum class AsyncQueueWaitStrategy
+{
+    // Block on a condition variable immediately. Uses no CPU while idle, but every item that
+    // arrives at an empty queue pays for waking the worker thread.
+    Block,
+
+    // Spin (then yield) for a short while watching for new items before blocking. The spin
+    // time adapts between zero and AsyncQueueOptions::maxSpinDuration: it grows when waits
+    // tend to end quickly and shrinks when they don't, so an idle queue stops spinning.
+    // Lowers latency for back-to-back request/response traffic at the cost of some CPU.
+    SpinThenPark,
+};
+
+// Construction options for an AsyncQueue.
+struct AsyncQueueOptions
+{
+    AsyncQueueOptions(AsyncQueueBackend backend = AsyncQueueBackend::Locked) :
+        backend(backend),
+        capacity(0),
+        overflowPolicy(AsyncQueueOverflowPolicy::Reject),
+        blockTimeout(std::chrono::milliseconds::max()),
+        laneCount(1),
+        agingInterval(100),
+        waitStrategy(AsyncQueueWaitStrategy::Block),
+        maxSpinDuration(50),
+        collectTimings(true)
+    {
+    }
+
+    AsyncQueueBackend backend;
+
+    // Maximum number of items waiting to be processed, or 0 for no limit.
+    size_t capacity;
+
+    AsyncQueueOverflowPolicy overflowPolicy;
+
+    // How long a push waits for space under the Block policy; max() waits indefinitely.
+    std::chrono::milliseconds blockTimeout;
+
+    // Number of priority lanes. Lane 0 has the highest priority; items are FIFO within a lane.
+    size_t laneCount;
+
+    // Starvation protection for multiple lanes: each full interval an item has waited raises
+    // it by one lane when choosing the next item. Zero disables aging (strict priority).
+    std::chrono::milliseconds agingInterval;
+
+    AsyncQueueWaitStrategy waitStrategy;
+
+    // Upper bound on how long the SpinThenPark strategy spins before blocking.
+    std::chrono::microseconds maxSpinDuration;
+
+    // Name, CPU affinity, scheduling policy and stack size of the worker thread.
+    ThreadOptions threadOptions;
+
+    // Whether to time each item's wait in the queue and its processing (see AsyncQueueStats).
+    // Costs a couple of clock reads per item; counters and depth are always collected.
+    bool collectTimings;
+};
+
+// Histogram of durations in microseconds, in power-of-two buckets: bucket 0 counts durations
+// under 1 us, bucket i (i > 0) counts durations in [2^(i-1), 2^i) us, and the last bucket
+// also counts everything longer.
+struct AsyncQueueDurationHistogram
+{
+    static const size_t BucketCount = 24;
+
+    AsyncQueueDurationHistogram() : count(0), totalMicroseconds(0), maxMicroseconds(0)
+    {
+        for (size_t i = 0; i < BucketCount; i++)
+        {
+            buckets[i] = 0;
+        }
+    }
+
+    static size_t GetBucket(uint64_t microseconds)
+    {
+        size_t bucket = 0;
+        while (microseconds != 0 && bucket < BucketCount - 1)
+        {
+            microseconds >>= 1;
+            bucket++;
+        }
+        return bucket;
+    }
+
+    void Add(uint64_t microseconds)
+    {
+        buckets[GetBucket(microseconds)]++;
+        count++;
+        totalMicroseconds += microseconds;
+        if (microseconds > maxMicroseconds)
+        {
+            maxMicroseconds = microseconds;
+        }
+    }
+
+    double GetMeanMicroseconds() const
+    {
+        return (count != 0 ? static_cast<double>(totalMicroseconds) / count : 0.0);
+    }
+
+    // Gets an upper bound on the given percentile (0-100): the upper end of the bucket that
+    // contains it, or the maximum if that is lower.
+    uint64_t GetPercentileMicroseconds(double percentile) const
+    {
+        uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * count);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BucketCount - 1; i++)
+        {
+            seen += buckets[i];
+            if (seen > rank)
+            {
+                uint64_t upperBound = static_cast<uint64_t>(1) << i;
+                return (upperBound < maxMicroseconds ? upperBound : maxMicroseconds);
+            }
+        }
+        return maxMicroseconds;
+    }
+
+    uint64_t buckets[BucketCount];
+    uint64_t count;
+    uint64_t totalMicroseconds;
+    uint64_t maxMicroseconds;
+};
+
+// Snapshot of an AsyncQueue's activity since it was created or its stats were last reset.
+struct AsyncQueueStats
+{
+    AsyncQueueStats() :
+        depth(0),
+        peakDepth(0),
+        enqueuedCount(0),
+        processedCount(0),
+        droppedCount(0),
+        exceptionCount(0),
+        spinWakeCount(0),
+        parkCount(0),
+        elapsed(0)
+    {
+    }
+
+    // Average number of items pushed per second over the elapsed time.
+    double GetEnqueueRate() const
+    {
+        double seconds = std::chrono::duration<double>(elapsed).count();
+        return (seconds > 0 ? enqueuedCount / seconds : 0.0);
+    }
+
+    // Items currently waiting, and the most that have waited at once.
+    size_t depth;
+    size_t peakDepth;
+
+    uint64_t enqueuedCount;
+    uint64_t processedCount;
+
+    // Items discarded by the DropOldest overflow policy.
+    uint64_t droppedCount;
+
+    // Exceptions thrown by the handler and caught by the worker thread.
+    uint64_t exceptionCount;
+
+    // Waits for items that ended while the worker was spinning, and waits that blocked the
+    // worker thread. Spin wakes are always zero with the Block wait strategy.
+    uint64_t spinWakeCount;
+    uint64_t parkCount;
+
+    std::chrono::steady_clock::duration elapsed;
+
+    // Time from push until processing started, and time spent processing. Empty unless
+    // AsyncQueueOptions::collectTimings is set.
+    AsyncQueueDurationHistogram waitTime;
+    AsyncQueueDurationHistogram handlerTime;
+};
+
+// Snapshot of the activity of one tenant of an AsyncQueue (see AsyncQueue::Push).
+struct AsyncQueueTenantStats
+{
+    AsyncQueueTenantStats() :
+        tenant(0),
+        weight(1),
+        depth(0),
+        enqueuedCount(0),
+        processedCount(0),
+        droppedCount(0)
+    {
+    }
+
+    size_t tenant;
+    unsigned int weight;
+
+    // Items of this tenant waiting in the queue. With the lock-free backend, items still in
+    // the inbox are only counted (including in enqueuedCount) once the worker has taken them.
+    size_t depth;
+
+    uint64_t enqueuedCount;
+
+    // Items that have started processing.
+    uint64_t processedCount;
+
+    uint64_t droppedCount;
+
+    // Time from push until processing started. Empty unless AsyncQueueOptions::collectTimings is set.
+    AsyncQueueDurationHistogram waitTime;
 };
 
 static bool s_crtIsTerminating = false;
@@ -34,11 +278,33 @@ static bool s_registered_atexit_handler = false;
 // Callers must register a handler interface during initialization.
 // Callers can push items onto the queue. The registered interface is then notified
 // from the AsyncQueue's worker thread to process each queued item.
+// Optionally the queue has multiple priority lanes; see AsyncQueueOptions::laneCount.
+// Within a lane, items may belong to different tenants (such as different clients sharing
+// the queue); tenants take turns by weighted round robin (see FairQueue), so one tenant
+// flooding the queue cannot starve the others. Items of a single tenant are FIFO.
 template <class QueueItem>
 class AsyncQueue
 {
 public:
-    AsyncQueue() :
+    AsyncQueue(const AsyncQueueOptions& options = AsyncQueueOptions()) :
+        _options(options),
+        _lanes(options.laneCount != 0 ? options.laneCount : 1),
+        _lastTenantStats(nullptr),
+        _itemCount(0),
+        _depth(0),
+        _highWaterMark(0),
+        _enqueuedCount(0),
+        _droppedCount(0),
+        _processedCount(0),
+        _exceptionCount(0),
+        _spinWakeCount(0),
+        _parkCount(0),
+        _statsStartTime(std::chrono::steady_clock::now().time_since_epoch().count()),
+        _workerParked(false),
+        _workerBusy(false),
+        _spinBudget(options.maxSpinDuration),
+        _idlePollPending(false),
+        _workerThreadId(std::thread::id()),
         _stopWorkerThread(false),
         _workerThreadStopped(false),
         _handler(nullptr),
@@ -76,7 +342,8 @@ public:
             // Start the thread.
             try
             {
-                _workerThread = std::thread(&AsyncQueue::WaitForAndProcessItems, this);
+                _workerThread.Start(_options.threadOptions, std::bind(&AsyncQueue::WaitForAndProcessItems, this));
+                _workerThreadId = _workerThread.GetId();
                 _isInitialized = true;
             }
             catch (const std::exception&)
@@ -91,76 +358,291 @@ public:
     void Uninitialize()
     {
         std::unique_lock<std::mutex> lock(_mutex);
-        std::queue<QueueItem> emptyQueue;
 
         if (_isInitialized)
         {
             if (!_stopWorkerThread)
             {
-                // Signal the worker thread to stop
+                // Signal the worker thread to stop, and release any producers blocked on a full queue
                 _stopWorkerThread = true;
                 _actionRequired.notify_one();
+                _notFull.notify_all();
 
                 // If the caller did not gracefully Uninitialize the queue and we are being destroyed as the result
                 // of the CRT being torn down, we need to modify our wait behavior.
                 // Wait for the worker thread to finish, unless the CRT is terminating (all std::threads will have been stopped if the CRT is terminating).
                 if (!s_crtIsTerminating)
                 {
-                    _actionRequired.wait(lock, [this] { return _workerThreadStopped || !_workerThread.joinable(); });
+                    _actionRequired.wait(lock, [this] { return _workerThreadStopped || !_workerThread.Joinable(); });
                 }
                 // Once we get here, the worker thread has finished all work and has exited the threadproc, or it has been terminated by the CRT.
                 // If it's in a joinable state, detach it.  Note that terminated/aborted threads are still joinable and must be detached (or joined)
                 // else the CRT will throw an exception.
-                if (_workerThread.joinable())
+                if (_workerThread.Joinable())
                 {
-                    _workerThread.detach();
+                    _workerThread.Detach();
                 }
             }
             // Clear state
-            _items.swap(emptyQueue);
+            for (FairQueue<Entry>& lane : _lanes)
+            {
+                lane.Clear();
+            }
+            for (auto tenant = _tenants.begin(); tenant != _tenants.end(); )
+            {
+                tenant->second.depth = 0;
+                if (IsIdleTenant(tenant->second))
+                {
+                    tenant = _tenants.erase(tenant);
+                }
+                else
+                {
+                    ++tenant;
+                }
+            }
+            _lastTenantStats = nullptr;
+            _itemCount = 0;
+            _inbox.Clear();
+            _depth = 0;
             _handler = nullptr;
             _workerThreadStopped = false;
             _isInitialized = false;
         }
     }
 
-    // Pushes another item onto the queue for processing later on the worker thread.
-    // Returns false and no-ops if the queue is not initialized.
+    // Pushes another item onto the queue for processing later on the worker thread, on
+    // behalf of the specified tenant (any key the caller chooses; 0 by default).
+    // Returns false and no-ops if the queue is not initialized, or if the queue is full
+    // and the overflow policy rejected the item. Lanes past the last one use the last lane.
     template <typename QueueItemType>
-    bool Push(QueueItemType&& item)
+    bool Push(QueueItemType&& item, size_t lane = 0, size_t tenant = 0)
     {
-        bool queueWasEmpty = false;
+        return PushEntry(std::forward<QueueItemType>(item), true, lane, tenant);
+    }
+
+    // Pushes an item regardless of the configured capacity. The item is never dropped
+    // by the DropOldest policy. Intended for rare control items that must not be shed.
+    template <typename QueueItemType>
+    bool PushUnbounded(QueueItemType&& item, size_t lane = 0, size_t tenant = 0)
+    {
+        return PushEntry(std::forward<QueueItemType>(item), false, lane, tenant);
+    }
 
+    // Pushes a sequence of items in order, taking the lock (or publishing to the lock-free
+    // inbox) and waking the worker once for the whole sequence rather than once per item.
+    // Items are moved out of the range. If the queue fills up, the overflow policy applies
+    // to each remaining item in turn; a rejection (or Block timeout) stops the push there.
+    // Returns the number of items pushed, which are always the first ones in the range.
+    template <typename Iterator>
+    size_t PushRange(Iterator first, Iterator last, size_t lane = 0, size_t tenant = 0)
+    {
+        if (lane >= _lanes.size())
         {
-            std::lock_guard<std::mutex> lock(_mutex);
+            lane = _lanes.size() - 1;
+        }
+
+        if (_options.backend == AsyncQueueBackend::LockFree)
+        {
+            return PushRangeLockFree(first, last, lane, tenant);
+        }
+
+        size_t pushed = 0;
+        bool notifyWorker = false;
+        std::vector<Entry> droppedEntries;
+        std::shared_ptr<IQueueItemHandler<QueueItem>> handler;
+
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
 
-            // Check whether this queue has been initialized
             if (!_isInitialized)
             {
-                return false;
+                return 0;
             }
 
-            queueWasEmpty = _items.empty();
-            _items.push(std::forward<QueueItemType>(item));
+            std::chrono::steady_clock::time_point enqueueTime = GetTimestamp();
+            for (; first != last; ++first)
+            {
+                bool dropped = false;
+                if (IsFull())
+                {
+                    if (_options.overflowPolicy == AsyncQueueOverflowPolicy::Block)
+                    {
+                        // The worker has to see the items pushed so far before it can make room.
+                        if (notifyWorker)
+                        {
+                            _actionRequired.notify_all();
+                            notifyWorker = false;
+                        }
+
+                        if (!WaitNotFull(lock))
+                        {
+                            break;
+                        }
+                    }
+                    else if (_options.overflowPolicy == AsyncQueueOverflowPolicy::DropOldest)
+                    {
+                        Entry droppedEntry;
+                        dropped = TryDropOldest(droppedEntry);
+                        if (dropped)
+                        {
+                            droppedEntries.push_back(std::move(droppedEntry));
+                            handler = _handler;
+                        }
+                    }
+                    else
+                    {
+                        break;
+                    }
+                }
+
+                notifyWorker = notifyWorker || (_itemCount == 0);
+                Enqueue(Entry(std::move(*first), true, lane, tenant, enqueueTime));
+                if (!dropped)
+                {
+                    IncrementDepth();
+                }
+                pushed++;
+            }
         }
 
-        // Only notify the worker thread if the queue is no longer empty
-        // (as that's the only way the worker thread would be waiting
-        // for this signal)
-        if (queueWasEmpty)
+        RecordEnqueued(pushed);
+
+        for (Entry& droppedEntry : droppedEntries)
+        {
+            NotifyDropped(handler, droppedEntry);
+        }
+
+        if (notifyWorker)
         {
             _actionRequired.notify_all();
         }
 
-        return true;
+        return pushed;
+    }
+
+    // Asks the worker to call the handler's OnIdle before it takes another item, such as after an
+    // item that started background work. Must be called on the worker thread, while it processes
+    // an item; only the worker thread touches the idle poll state.
+    void RequestIdle()
+    {
+        _idlePollPending = true;
+        _idlePollDeadline = std::chrono::steady_clock::now();
     }
 
-    // Waits until the queue is empty
+    // Waits until the queue is empty and the worker has finished processing its current item
     void WaitForAll()
     {
         std::unique_lock<std::mutex> lock(_mutex);
 
-        _isEmpty.wait(lock, [this] {return (_items.empty() || _stopWorkerThread); });
+        _isEmpty.wait(lock, [this] {return ((_itemCount == 0 && _inbox.IsEmpty() && !_workerBusy) || _stopWorkerThread); });
+    }
+
+    const AsyncQueueOptions& GetOptions() const
+    {
+        return _options;
+    }
+
+    // Gets the number of items waiting to be processed.
+    size_t GetDepth() const
+    {
+        return _depth.load(std::memory_order_relaxed);
+    }
+
+    // Gets the largest number of items that have been waiting at once since the last reset.
+    size_t GetHighWaterMark() const
+    {
+        return _highWaterMark.load(std::memory_order_relaxed);
+    }
+
+    void ResetHighWaterMark()
+    {
+        _highWaterMark.store(_depth.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    // Gets a snapshot of the queue's counters and timings. Counters are read individually
+    // without a lock, so a snapshot taken while items are flowing may be slightly inconsistent.
+    AsyncQueueStats GetStats() const
+    {
+        AsyncQueueStats stats;
+        stats.depth = GetDepth();
+        stats.peakDepth = GetHighWaterMark();
+        stats.enqueuedCount = _enqueuedCount.load(std::memory_order_relaxed);
+        stats.processedCount = _processedCount.load(std::memory_order_relaxed);
+        stats.droppedCount = _droppedCount.load(std::memory_order_relaxed);
+        stats.exceptionCount = _exceptionCount.load(std::memory_order_relaxed);
+        stats.spinWakeCount = _spinWakeCount.load(std::memory_order_relaxed);
+        stats.parkCount = _parkCount.load(std::memory_order_relaxed);
+        stats.elapsed = std::chrono::steady_clock::now() -
+            std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(
+                _statsStartTime.load(std::memory_order_relaxed)));
+        _waitTime.GetSnapshot(stats.waitTime);
+        _handlerTime.GetSnapshot(stats.handlerTime);
+        return stats;
+    }
+
+    // Restarts stats collection, including the peak depth. Updates made by the worker thread
+    // while the reset is in progress may survive it.
+    void ResetStats()
+    {
+        ResetHighWaterMark();
+        _enqueuedCount.store(0, std::memory_order_relaxed);
+        _processedCount.store(0, std::memory_order_relaxed);
+        _droppedCount.store(0, std::memory_order_relaxed);
+        _exceptionCount.store(0, std::memory_order_relaxed);
+        _spinWakeCount.store(0, std::memory_order_relaxed);
+        _parkCount.store(0, std::memory_order_relaxed);
+        _waitTime.Reset();
+        _handlerTime.Reset();
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (auto& tenant : _tenants)
+            {
+                AsyncQueueTenantStats& tenantStats = tenant.second;
+                tenantStats.enqueuedCount = 0;
+                tenantStats.processedCount = 0;
+                tenantStats.droppedCount = 0;
+                tenantStats.waitTime = AsyncQueueDurationHistogram();
+            }
+        }
+        _statsStartTime.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+    }
+
+    // Gets the ID of the worker thread, or a default ID when the queue is not running.
+    std::thread::id GetWorkerThreadId() const
+    {
+        return _workerThreadId.load();
+    }
+
+    // Returns true if called from within the worker thread (i.e. while processing an item).
+    bool IsWorkerThread() const
+    {
+        return std::this_thread::get_id() == _workerThreadId.load();
+    }
+
+    // Sets a tenant's share of the worker relative to other tenants with items waiting in the
+    // same lane: each turn the tenant gets, it may run up to this many items. The default is 1.
+    // Takes effect from the tenant's next turn.
+    void SetTenantWeight(size_t tenant, unsigned int weight)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        AsyncQueueTenantStats& tenantStats = GetTenant(tenant);
+        tenantStats.weight = (weight != 0 ? weight : 1);
+        ReleaseIdleTenant(tenantStats);
+    }
+
+    // Gets the stats of the default tenant 0, of every tenant with items waiting, and of every
+    // tenant with a weight other than 1. Other tenants are forgotten (with their counts) once
+    // their last item is taken, so that tenant keys that come and go do not accumulate.
+    std::vector<AsyncQueueTenantStats> GetTenantStats() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::vector<AsyncQueueTenantStats> tenantStats;
+        tenantStats.reserve(_tenants.size());
+        for (const auto& tenant : _tenants)
+        {
+            tenantStats.push_back(tenant.second);
+        }
+        return tenantStats;
     }
 
 private:
@@ -177,60 +659,816 @@ private:
         std::unique_lock<std::mutex>& _lock;
     };
 
-    void WaitForAndProcessItems()
+    // A queued item plus the bookkeeping the queue needs for it.
+    struct Entry
     {
-        std::unique_lock<std::mutex> lock(_mutex);
+        Entry() : bounded(true), lane(0), tenant(0) { }
 
-        std::shared_ptr<IQueueItemHandler<QueueItem>> handler = _handler;
-        handler->OnStarted();
+        template <typename QueueItemType>
+        Entry(
+            QueueItemType&& item,
+            bool bounded,
+            size_t lane,
+            size_t tenant,
+            std::chrono::steady_clock::time_point enqueueTime) :
+            item(std::forward<QueueItemType>(item)),
+            bounded(bounded),
+            lane(lane),
+            tenant(tenant),
+            enqueueTime(enqueueTime)
+        {
+        }
 
-        for (;;)
+        QueueItem item;
+
+        // False for items pushed with PushUnbounded.
+        bool bounded;
+
+        size_t lane;
+        size_t tenant;
+
+        // Only recorded when timings are collected or aging between multiple lanes is enabled.
+        std::chrono::steady_clock::time_point enqueueTime;
+    };
+
+    // Worker-thread side of an AsyncQueueDurationHistogram; see AddToCounter.
+    class DurationRecorder
+    {
+    public:
+        DurationRecorder()
         {
-            // Wait until either:
-            // - queue is not empty
-            // - worker thread has been asked to stop
-            _actionRequired.wait(lock, [this] { if (_items.empty()) _isEmpty.notify_all(); return (!_items.empty() || _stopWorkerThread); });
-            if (_stopWorkerThread)
+            Reset();
+        }
+
+        void Record(std::chrono::steady_clock::duration duration)
+        {
+            uint64_t microseconds = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+
+            AddToCounter(_buckets[AsyncQueueDurationHistogram::GetBucket(microseconds)], 1);
+            AddToCounter(_count, 1);
+            AddToCounter(_totalMicroseconds, microseconds);
+            if (microseconds > _maxMicroseconds.load(std::memory_order_relaxed))
+            {
+                _maxMicroseconds.store(microseconds, std::memory_order_relaxed);
+            }
+        }
+
+        void GetSnapshot(AsyncQueueDurationHistogram& histogram) const
+        {
+            for (size_t i = 0; i < AsyncQueueDurationHistogram::BucketCount; i++)
+            {
+                histogram.buckets[i] = _buckets[i].load(std::memory_order_relaxed);
+            }
+            histogram.count = _count.load(std::memory_order_relaxed);
+            histogram.totalMicroseconds = _totalMicroseconds.load(std::memory_order_relaxed);
+            histogram.maxMicroseconds = _maxMicroseconds.load(std::memory_order_relaxed);
+        }
+
+        void Reset()
+        {
+            for (size_t i = 0; i < AsyncQueueDurationHistogram::BucketCount; i++)
             {
-                break;
+                _buckets[i].store(0, std::memory_order_relaxed);
             }
+            _count.store(0, std::memory_order_relaxed);
+            _totalMicroseconds.store(0, std::memory_order_relaxed);
+            _maxMicroseconds.store(0, std::memory_order_relaxed);
+        }
 
-            // Move the items to a temporary queue
-            std::queue<QueueItem> items(std::move(_items));
+    private:
+        std::atomic<uint64_t> _buckets[AsyncQueueDurationHistogram::BucketCount];
+        std::atomic<uint64_t> _count;
+        std::atomic<uint64_t> _totalMicroseconds;
+        std::atomic<uint64_t> _maxMicroseconds;
+    };
 
-            // Process all queue items outside the lock, the UnlockGuard will re-lock on destruction
-            UnlockGuard unlock(lock);
+    template <typename QueueItemType>
+    bool PushEntry(QueueItemType&& item, bool bounded, size_t lane, size_t tenant)
+    {
+        if (lane >= _lanes.size())
+        {
+            lane = _lanes.size() - 1;
+        }
 
-            while (!items.empty())
+        if (_options.backend == AsyncQueueBackend::LockFree)
+        {
+            return PushEntryLockFree(std::forward<QueueItemType>(item), bounded, lane, tenant);
+        }
+
+        bool queueWasEmpty = false;
+        Entry droppedEntry;
+        bool dropped = false;
+        std::shared_ptr<IQueueItemHandler<QueueItem>> handler;
+
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            // Check whether this queue has been initialized
+            if (!_isInitialized)
             {
-                // Pop the next item off and notify the registered worker to process it
-                QueueItem item = std::move(items.front());
-                items.pop();
+                return false;
+            }
 
-                try
-                {
-                    handler->OnProcessQueueItem(item);
-                }
-                catch (...)
+            if (bounded && IsFull())
+            {
+                switch (_options.overflowPolicy)
                 {
-                    LogWarning("Caught exception while processing async queue items.");
+                case AsyncQueueOverflowPolicy::Block:
+                    if (!WaitNotFull(lock))
+                    {
+                        return false;
+                    }
+                    break;
+
+                case AsyncQueueOverflowPolicy::DropOldest:
+                    dropped = TryDropOldest(droppedEntry);
+                    handler = _handler;
+                    break;
+
+                case AsyncQueueOverflowPolicy::Reject:
+                default:
+                    return false;
                 }
             }
+
+            queueWasEmpty = (_itemCount == 0);
+            Enqueue(Entry(std::forward<QueueItemType>(item), bounded, lane, tenant, GetTimestamp()));
+            if (!dropped)
+            {
+                IncrementDepth();
+            }
         }
 
-        try
+        RecordEnqueued(1);
+
+        if (dropped)
         {
-            handler->OnStopped();
+            NotifyDropped(handler, droppedEntry);
         }
-        catch (...)
+
+        // Only notify the worker thread if the queue is no longer empty
+        // (as that's the only way the worker thread would be waiting
+        // for this signal)
+        if (queueWasEmpty)
         {
-            LogWarning("Caught exception while stopping async queue handler.");
+            _actionRequired.notify_all();
         }
 
-        // Signal that the thread is done
-        _workerThreadStopped = true;
-        _actionRequired.notify_all();
-        //std::notify_all_at_thread_exit(_actionRequired, std::move(lock)); // This should replace the previous line but Android doesn't support it
+        return true;
+    }
+
+    template <typename QueueItemType>
+    bool PushEntryLockFree(QueueItemType&& item, bool bounded, size_t lane, size_t tenant)
+    {
+        // Items pushed concurrently with Uninitialize may be discarded without processing.
+        if (!_isInitialized)
+        {
+            return false;
+        }
+
+        if (bounded && _options.capacity != 0)
+        {
+            // Reserve a slot without taking the mutex; only overflow takes the slow path.
+            for (;;)
+            {
+                size_t depth = _depth.fetch_add(1);
+                if (depth < _options.capacity)
+                {
+                    UpdateHighWaterMark(depth + 1);
+                    break;
+                }
+
+                _depth.fetch_sub(1);
+
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (_options.overflowPolicy == AsyncQueueOverflowPolicy::DropOldest)
+                {
+                    return PushDropOldestLockFree(lock, std::forward<QueueItemType>(item), lane, tenant);
+                }
+                else if (_options.overflowPolicy != AsyncQueueOverflowPolicy::Block || !WaitNotFull(lock))
+                {
+                    return false;
+                }
+            }
+        }
+        else
+        {
+            IncrementDepth();
+        }
+
+        _inbox.Push(Entry(std::forward<QueueItemType>(item), bounded, lane, tenant, GetTimestamp()));
+        RecordEnqueued(1);
+        WakeParkedWorker();
+        return true;
+    }
+
+    template <typename Iterator>
+    size_t PushRangeLockFree(Iterator first, Iterator last, size_t lane, size_t tenant)
+    {
+        if (!_isInitialized)
+        {
+            return 0;
+        }
+
+        std::chrono::steady_clock::time_point enqueueTime = GetTimestamp();
+        size_t pushed = 0;
+        while (first != last)
+        {
+            size_t reserved = ReserveDepth(static_cast<size_t>(std::distance(first, last)));
+            if (reserved == 0)
+            {
+                // The queue is full, so the overflow policy applies to the next item on its own.
+                if (!PushEntryLockFree(std::move(*first), true, lane, tenant))
+                {
+                    break;
+                }
+
+                ++first;
+                pushed++;
+                continue;
+            }
+
+            typename MpscQueue<Entry>::Batch batch;
+            for (size_t i = 0; i < reserved; i++, ++first)
+            {
+                batch.Push(Entry(std::move(*first), true, lane, tenant, enqueueTime));
+            }
+
+            _inbox.PushBatch(batch);
+            RecordEnqueued(reserved);
+            WakeParkedWorker();
+            pushed += reserved;
+        }
+
+        return pushed;
+    }
+
+    // Reserves depth for up to count items without taking the mutex, limited by the queue
+    // capacity (if any). Returns the number of items reserved, 0 if the queue is full.
+    size_t ReserveDepth(size_t count)
+    {
+        if (_options.capacity == 0)
+        {
+            UpdateHighWaterMark(_depth.fetch_add(count) + count);
+            return count;
+        }
+
+        size_t depth = _depth.load();
+        for (;;)
+        {
+            if (depth >= _options.capacity)
+            {
+                return 0;
+            }
+
+            size_t reserved = (count < _options.capacity - depth ? count : _options.capacity - depth);
+            if (_depth.compare_exchange_weak(depth, depth + reserved))
+            {
+                UpdateHighWaterMark(depth + reserved);
+                return reserved;
+            }
+        }
+    }
+
+    // Overflow path of a lock-free DropOldest push. Holding the mutex makes this thread the
+    // inbox consumer, so it can move waiting items into the lanes and drop the oldest one.
+    template <typename QueueItemType>
+    bool PushDropOldestLockFree(std::unique_lock<std::mutex>& lock, QueueItemType&& item, size_t lane, size_t tenant)
+    {
+        if (!_isInitialized || _stopWorkerThread)
+        {
+            return false;
+        }
+
+        DrainInbox();
+
+        Entry droppedEntry;
+        bool dropped = TryDropOldest(droppedEntry);
+        if (!dropped)
+        {
+            // Nothing droppable is visible yet (e.g. only unbounded items are waiting),
+            // so accept the item and briefly exceed the capacity.
+            IncrementDepth();
+        }
+
+        Enqueue(Entry(std::forward<QueueItemType>(item), true, lane, tenant, GetTimestamp()));
+        RecordEnqueued(1);
+        _workerParked.store(false);
+        _actionRequired.notify_all();
+
+        std::shared_ptr<IQueueItemHandler<QueueItem>> handler = _handler;
+        lock.unlock();
+
+        if (dropped)
+        {
+            NotifyDropped(handler, droppedEntry);
+        }
+
+        return true;
+    }
+
+    bool IsFull() const
+    {
+        return _options.capacity != 0 && _depth.load() >= _options.capacity;
+    }
+
+    // Waits under the Block policy until the queue has space. Returns false on timeout,
+    // when the queue is stopping, or when called from the worker thread (which would deadlock).
+    bool WaitNotFull(std::unique_lock<std::mutex>& lock)
+    {
+        if (IsWorkerThread())
+        {
+            return false;
+        }
+
+        auto hasSpaceOrStopping = [this] { return !IsFull() || _stopWorkerThread || !_isInitialized; };
+        if (_options.blockTimeout == std::chrono::milliseconds::max())
+        {
+            _notFull.wait(lock, hasSpaceOrStopping);
+        }
+        else if (!_notFull.wait_for(lock, _options.blockTimeout, hasSpaceOrStopping))
+        {
+            return false;
+        }
+
+        return !_stopWorkerThread && _isInitialized;
+    }
+
+    // Removes the oldest bounded item from the lowest-priority lane that has one, taking it
+    // from the tenant with the most items in that lane. Must be called with the mutex held.
+    bool TryDropOldest(Entry& droppedEntry)
+    {
+        for (size_t lane = _lanes.size(); lane-- > 0; )
+        {
+            size_t tenant;
+            if (_lanes[lane].RemoveFirst([](const Entry& entry) { return entry.bounded; }, droppedEntry, tenant))
+            {
+                AsyncQueueTenantStats& tenantStats = GetTenant(tenant);
+                tenantStats.depth--;
+                tenantStats.droppedCount++;
+                ReleaseIdleTenant(tenantStats);
+                _itemCount--;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Gets the current time if it will be used (for timings or aging), else a default time point.
+    std::chrono::steady_clock::time_point GetTimestamp() const
+    {
+        return (_options.collectTimings || (_lanes.size() > 1 && _options.agingInterval.count() > 0) ?
+            std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point());
+    }
+
+    // Must be called with the mutex held.
+    void Enqueue(Entry&& entry)
+    {
+        size_t lane = entry.lane;
+        size_t tenant = entry.tenant;
+        AsyncQueueTenantStats& tenantStats = GetTenant(tenant);
+        tenantStats.depth++;
+        tenantStats.enqueuedCount++;
+        _lanes[lane].Push(tenant, tenantStats.weight, std::move(entry));
+        _itemCount++;
+    }
+
+    // Gets (creating if necessary) a tenant's stats, which also hold its weight.
+    // Must be called with the mutex held.
+    AsyncQueueTenantStats& GetTenant(size_t tenant)
+    {
+        // Usually the same tenant pushes many items in a row. Elements of an unordered_map
+        // never move, so the cached pointer stays valid.
+        if (_lastTenantStats == nullptr || _lastTenantStats->tenant != tenant)
+        {
+            _lastTenantStats = &_tenants[tenant];
+            _lastTenantStats->tenant = tenant;
+        }
+
+        return *_lastTenantStats;
+    }
+
+    // Whether a tenant's stats can be forgotten: it has no items waiting and the default
+    // weight. The default tenant is kept, so that the single-tenant case does not allocate.
+    static bool IsIdleTenant(const AsyncQueueTenantStats& tenantStats)
+    {
+        return tenantStats.depth == 0 && tenantStats.weight == 1 && tenantStats.tenant != 0;
+    }
+
+    // Forgets an idle tenant's stats. Must be called with the mutex held.
+    void ReleaseIdleTenant(AsyncQueueTenantStats& tenantStats)
+    {
+        if (IsIdleTenant(tenantStats))
+        {
+            if (_lastTenantStats == &tenantStats)
+            {
+                _lastTenantStats = nullptr;
+            }
+
+            size_t tenant = tenantStats.tenant;
+            _tenants.erase(tenant);
+        }
+    }
+
+    // Removes the next item to process. With one lane this is simply the oldest item.
+    // Otherwise it is the head of the lane with the best rank, where an item's rank is its
+    // lane minus the number of aging intervals it has waited; ties go to the higher-priority
+    // lane. Within the lane, tenants take turns. The time is from GetTimestamp. Must be called
+    // with the mutex held and at least one item queued.
+    Entry Dequeue(std::chrono::steady_clock::time_point now)
+    {
+        size_t bestLane = 0;
+        while (_lanes[bestLane].IsEmpty())
+        {
+            bestLane++;
+        }
+
+        if (_options.agingInterval.count() > 0)
+        {
+            long long bestRank = static_cast<long long>(bestLane);
+            for (size_t lane = bestLane + 1; lane < _lanes.size(); lane++)
+            {
+                if (!_lanes[lane].IsEmpty())
+                {
+                    long long intervalsWaited = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        now - _lanes[lane].Front().enqueueTime).count() / _options.agingInterval.count();
+                    long long rank = static_cast<long long>(lane) - intervalsWaited;
+                    if (rank < bestRank)
+                    {
+                        bestRank = rank;
+                        bestLane = lane;
+                    }
+                }
+            }
+        }
+
+        Entry entry = std::move(_lanes[bestLane].Front());
+        _lanes[bestLane].Pop();
+        _itemCount--;
+
+        AsyncQueueTenantStats& tenantStats = GetTenant(entry.tenant);
+        tenantStats.depth--;
+        tenantStats.processedCount++;
+        if (_options.collectTimings)
+        {
+            tenantStats.waitTime.Add(static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(now - entry.enqueueTime).count()));
+        }
+
+        ReleaseIdleTenant(tenantStats);
+        return entry;
+    }
+
+    void NotifyDropped(const std::shared_ptr<IQueueItemHandler<QueueItem>>& handler, Entry& droppedEntry)
+    {
+        _droppedCount.fetch_add(1, std::memory_order_relaxed);
+        LogVerbose("Async queue is full; dropped the oldest item.");
+
+        try
+        {
+            handler->OnDropQueueItem(droppedEntry.item);
+        }
+        catch (...)
+        {
+            LogWarning("Caught exception while dropping async queue item.");
+        }
+    }
+
+    void IncrementDepth()
+    {
+        UpdateHighWaterMark(_depth.fetch_add(1) + 1);
+    }
+
+    void UpdateHighWaterMark(size_t depth)
+    {
+        size_t highWaterMark = _highWaterMark.load(std::memory_order_relaxed);
+        while (depth > highWaterMark &&
+            !_highWaterMark.compare_exchange_weak(highWaterMark, depth, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    void RecordEnqueued(size_t count)
+    {
+        _enqueuedCount.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    // Increments a counter that only the worker thread writes. Other threads only read it
+    // (or reset it), so a relaxed load and store is enough and avoids a locked instruction.
+    static void AddToCounter(std::atomic<uint64_t>& counter, uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    void WaitForAndProcessItems()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        std::shared_ptr<IQueueItemHandler<QueueItem>> handler = _handler;
+        handler->OnStarted();
+
+        // Wait until either:
+        // - queue is not empty
+        // - worker thread has been asked to stop
+        while (WaitForItems(lock, handler))
+        {
+            // Pop the next item off, then process it outside the lock; the UnlockGuard will
+            // re-lock on destruction. Items are taken one at a time so that overflow handling
+            // can still reach everything that has not started processing, and so that a
+            // higher-priority item pushed meanwhile is picked up next.
+            std::chrono::steady_clock::time_point startTime = GetTimestamp();
+            Entry entry = Dequeue(startTime);
+            _depth.fetch_sub(1);
+            _workerBusy = true;
+
+            if (_options.capacity != 0)
+            {
+                _notFull.notify_one();
+            }
+
+            {
+                UnlockGuard unlock(lock);
+
+                if (_options.collectTimings)
+                {
+                    _waitTime.Record(startTime - entry.enqueueTime);
+                }
+
+                try
+                {
+                    // Notify the registered worker to process the item
+                    handler->OnProcessQueueItem(entry.item);
+                }
+                catch (...)
+                {
+                    LogWarning("Caught exception while processing async queue items.");
+                    AddToCounter(_exceptionCount, 1);
+                }
+
+                if (_options.collectTimings)
+                {
+                    _handlerTime.Record(std::chrono::steady_clock::now() - startTime);
+                }
+
+                AddToCounter(_processedCount, 1);
+            }
+
+            _workerBusy = false;
+        }
+
+        try
+        {
+            handler->OnStopped();
+        }
+        catch (...)
+        {
+            LogWarning("Caught exception while stopping async queue handler.");
+            AddToCounter(_exceptionCount, 1);
+        }
+
+        // Signal that the thread is done
+        _workerThreadId = std::thread::id();
+        _workerThreadStopped = true;
+        _actionRequired.notify_all();
+        //std::notify_all_at_thread_exit(_actionRequired, std::move(lock)); // This should replace the previous line but Android doesn't support it
+    }
+
+    // Waits until an item is queued (returns true) or the worker has been asked to stop
+    // (returns false), calling the handler's OnIdle as it asks. Must be called with the queue
+    // mutex held.
+    bool WaitForItems(std::unique_lock<std::mutex>& lock, const std::shared_ptr<IQueueItemHandler<QueueItem>>& handler)
+    {
+        bool spinThenPark = (_options.waitStrategy == AsyncQueueWaitStrategy::SpinThenPark);
+        bool spun = false;
+        bool idled = false;
+        for (;;)
+        {
+            DrainInbox();
+
+            if (_stopWorkerThread)
+            {
+                return false;
+            }
+
+            if (_itemCount != 0)
+            {
+                if (_idlePollPending && !idled && std::chrono::steady_clock::now() >= _idlePollDeadline)
+                {
+                    // Don't let a steady stream of items starve the handler's background work.
+                    idled = true;
+                    RunIdle(lock, handler);
+                    continue;
+                }
+
+                return true;
+            }
+
+            if (!_inbox.IsEmpty())
+            {
+                // A producer is between publishing its node and linking it; it will finish shortly.
+                UnlockGuard unlock(lock);
+                std::this_thread::yield();
+                continue;
+            }
+
+            _isEmpty.notify_all();
+
+            if (!idled)
+            {
+                // Handler work may push items, so go around again afterwards.
+                idled = true;
+                RunIdle(lock, handler);
+                continue;
+            }
+
+            if (spinThenPark && !spun)
+            {
+                // Spinning releases the lock, so go around again afterwards to pick up anything
+                // pushed meanwhile (those pushes may have skipped waking the worker).
+                spun = true;
+                SpinForItems(lock);
+                continue;
+            }
+
+            std::chrono::steady_clock::time_point parkTime;
+            if (spinThenPark)
+            {
+                parkTime = std::chrono::steady_clock::now();
+            }
+
+            AddToCounter(_parkCount, 1);
+            if (_options.backend == AsyncQueueBackend::LockFree)
+            {
+                // Announce that the worker is about to park, then re-check the inbox. Producers push
+                // before checking the flag, so at least one side always observes the other.
+                _workerParked.store(true);
+                if (_inbox.IsEmpty())
+                {
+                    auto woken = [this] { return !_workerParked.load() || _stopWorkerThread; };
+                    if (_idlePollPending)
+                    {
+                        _actionRequired.wait_until(lock, _idlePollDeadline, woken);
+                    }
+                    else
+                    {
+                        _actionRequired.wait(lock, woken);
+                    }
+                }
+                _workerParked.store(false);
+            }
+            else if (_idlePollPending)
+            {
+                _actionRequired.wait_until(lock, _idlePollDeadline);
+            }
+            else
+            {
+                _actionRequired.wait(lock);
+            }
+
+            if (_idlePollPending && std::chrono::steady_clock::now() >= _idlePollDeadline)
+            {
+                // Time to poll the handler's background work again.
+                idled = false;
+            }
+            else if (spinThenPark)
+            {
+                // A wait that a full-length spin would have covered means spinning is paying off.
+                AdaptSpinBudget(std::chrono::steady_clock::now() - parkTime <= _options.maxSpinDuration);
+            }
+        }
+    }
+
+    // Calls the handler's OnIdle without the lock, and records when it asked to be called again.
+    void RunIdle(std::unique_lock<std::mutex>& lock, const std::shared_ptr<IQueueItemHandler<QueueItem>>& handler)
+    {
+        std::chrono::steady_clock::duration pollInterval = std::chrono::steady_clock::duration::max();
+        {
+            UnlockGuard unlock(lock);
+
+            try
+            {
+                pollInterval = handler->OnIdle();
+            }
+            catch (...)
+            {
+                LogWarning("Caught exception while running async queue idle work.");
+                AddToCounter(_exceptionCount, 1);
+            }
+        }
+
+        _idlePollPending = (pollInterval != std::chrono::steady_clock::duration::max());
+        if (_idlePollPending)
+        {
+            _idlePollDeadline = std::chrono::steady_clock::now() + pollInterval;
+        }
+    }
+
+    // Releases the lock and watches for a push for up to the current spin budget, first
+    // busy-waiting and then yielding the CPU. Returns true if a push was seen.
+    bool SpinForItems(std::unique_lock<std::mutex>& lock)
+    {
+        if (_spinBudget == std::chrono::steady_clock::duration::zero())
+        {
+            return false;
+        }
+
+        // Every push bumps the enqueued count once its item is visible to the worker (or, for
+        // the lock-free backend, shortly after it reaches the inbox), so watching the count
+        // needs no lock. A stats reset also changes it, which just ends this spin early.
+        const uint64_t enqueuedCount = _enqueuedCount.load(std::memory_order_relaxed);
+
+        // Busy-waiting on a single CPU only delays the producer, so just yield there.
+        static const unsigned int busyIterations = (std::thread::hardware_concurrency() > 1 ? 64 : 0);
+
+        UnlockGuard unlock(lock);
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + _spinBudget;
+        for (unsigned int i = 0; ; i++)
+        {
+            if (_enqueuedCount.load(std::memory_order_relaxed) != enqueuedCount ||
+                (_options.backend == AsyncQueueBackend::LockFree && !_inbox.IsEmpty()))
+            {
+                AddToCounter(_spinWakeCount, 1);
+                AdaptSpinBudget(true);
+                return true;
+            }
+
+            if (std::chrono::steady_clock::now() >= deadline)
+            {
+                return false;
+            }
+
+            if (i < busyIterations)
+            {
+                CpuRelax();
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // Doubles the spin budget after a wait that ended quickly and halves it otherwise. A budget
+    // that falls below a sixteenth of the maximum drops to zero (no spinning) until waits
+    // start ending quickly again.
+    void AdaptSpinBudget(bool waitEndedQuickly)
+    {
+        std::chrono::steady_clock::duration maxBudget = _options.maxSpinDuration;
+        if (waitEndedQuickly)
+        {
+            _spinBudget = (_spinBudget == std::chrono::steady_clock::duration::zero() ? maxBudget / 8 : _spinBudget * 2);
+            if (_spinBudget > maxBudget)
+            {
+                _spinBudget = maxBudget;
+            }
+        }
+        else
+        {
+            _spinBudget /= 2;
+            if (_spinBudget < maxBudget / 16)
+            {
+                _spinBudget = std::chrono::steady_clock::duration::zero();
+            }
+        }
+    }
+
+    // Hints to the CPU that this is a spin-wait loop.
+    static void CpuRelax()
+    {
+#if defined(__i386__) || defined(__x86_64__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__) || (defined(__arm__) && __ARM_ARCH >= 7)
+        __asm__ __volatile__("yield");
+#endif
+    }
+
+    // Moves everything from the lock-free inbox into the lanes. Must be called with the queue
+    // mutex held; the mutex also serializes inbox consumers.
+    void DrainInbox()
+    {
+        if (_options.backend == AsyncQueueBackend::LockFree)
+        {
+            Entry entry;
+            while (_inbox.TryPop(entry))
+            {
+                Enqueue(std::move(entry));
+            }
+        }
+    }
+
+    // Called by lock-free producers after pushing onto the inbox.
+    void WakeParkedWorker()
+    {
+        if (_workerParked.load() && _workerParked.exchange(false))
+        {
+            // Notify under the mutex so the wakeup cannot slip in between the worker's
+            // predicate check and its wait. Uninitialize waits on the same condition, so
+            // notify everyone rather than risk waking only that waiter.
+            std::lock_guard<std::mutex> lock(_mutex);
+            _actionRequired.notify_all();
+        }
     }
 
     static void AsyncQueue_atexit_handler()
@@ -238,15 +1476,38 @@ private:
         s_crtIsTerminating = true;
     }
 
-    std::queue<QueueItem> _items;
+    const AsyncQueueOptions _options;
+    std::vector<FairQueue<Entry>> _lanes;
+    std::unordered_map<size_t, AsyncQueueTenantStats> _tenants;
+    AsyncQueueTenantStats* _lastTenantStats;
+    size_t _itemCount;
+    MpscQueue<Entry> _inbox;
+    std::atomic<size_t> _depth;
+    std::atomic<size_t> _highWaterMark;
+    std::atomic<uint64_t> _enqueuedCount;
+    std::atomic<uint64_t> _droppedCount;
+    std::atomic<uint64_t> _processedCount;
+    std::atomic<uint64_t> _exceptionCount;
+    std::atomic<uint64_t> _spinWakeCount;
+    std::atomic<uint64_t> _parkCount;
+    std::atomic<std::chrono::steady_clock::rep> _statsStartTime;
+    DurationRecorder _waitTime;
+    DurationRecorder _handlerTime;
+    std::atomic<bool> _workerParked;
+    bool _workerBusy;
+    std::chrono::steady_clock::duration _spinBudget;
+    bool _idlePollPending;
+    std::chrono::steady_clock::time_point _idlePollDeadline;
     std::condition_variable _actionRequired;
     std::condition_variable _isEmpty;
-    std::mutex _mutex;
-    std::thread _workerThread;
+    std::condition_variable _notFull;
+    mutable std::mutex _mutex;
+    NativeThread _workerThread;
+    std::atomic<std::thread::id> _workerThreadId;
     bool _stopWorkerThread;
     bool _workerThreadStopped;
     std::shared_ptr<IQueueItemHandler<QueueItem>> _handler;
-    bool _isInitialized;
+    std::atomic<bool> _isInitialized;
 };
 
 }
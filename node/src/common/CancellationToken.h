@@ -0,0 +1,100 @@
+//
+// Copyright (c) 2015, Microsoft Corporation
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR
+// IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+namespace OpenT2T
+{
+
+// Error reported for work that was cancelled before it ran.
+class CancelledError : public std::runtime_error
+{
+public:
+    CancelledError() : std::runtime_error("The operation was cancelled.") { }
+};
+
+// Flag shared by a group of pending operations so they can all be cancelled at once: Cancel
+// is a single atomic store however many operations share the token, and each operation checks
+// the flag just before it would start. Copies refer to the same flag. A child token is also
+// cancelled when its parent is, so work can be grouped at more than one level (for example
+// per screen, and per device within it). A default-constructed token is never cancelled.
+class CancellationToken
+{
+public:
+    CancellationToken() { }
+
+    // Creates a new token that can be cancelled.
+    static CancellationToken Create()
+    {
+        return CancellationToken(std::make_shared<State>(nullptr));
+    }
+
+    // Creates a new token that is cancelled when either it or this token is cancelled.
+    CancellationToken CreateChild() const
+    {
+        return CancellationToken(std::make_shared<State>(_state));
+    }
+
+    // Returns false for a default-constructed token.
+    bool CanBeCancelled() const
+    {
+        return _state != nullptr;
+    }
+
+    // Cancels every operation holding this token or a child of it that has not yet started.
+    void Cancel() const
+    {
+        if (_state != nullptr)
+        {
+            _state->cancelled.store(true, std::memory_order_release);
+        }
+    }
+
+    bool IsCancelled() const
+    {
+        for (const State* state = _state.get(); state != nullptr; state = state->parent.get())
+        {
+            if (state->cancelled.load(std::memory_order_acquire))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Throws CancelledError if the token has been cancelled.
+    void ThrowIfCancelled() const
+    {
+        if (IsCancelled())
+        {
+            throw CancelledError();
+        }
+    }
+
+private:
+    struct State
+    {
+        State(const std::shared_ptr<State>& parent) : cancelled(false), parent(parent) { }
+
+        std::atomic<bool> cancelled;
+        std::shared_ptr<State> parent;
+    };
+
+    CancellationToken(std::shared_ptr<State>&& state) : _state(std::move(state)) { }
+
+    std::shared_ptr<State> _state;
+};
+
+}
@@ -0,0 +1,192 @@
+//
+// Copyright (c) 2015, Microsoft Corporation
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR
+// IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+namespace OpenT2T
+{
+
+// Implements a queue that shares its output between tenants by weighted round robin (deficit
+// round robin where every item costs one). Each tenant's items stay FIFO in their own
+// RingQueue; tenants that have items take turns, and a tenant's turn lasts for as many items
+// as its weight. So a tenant that floods the queue only delays the others by its weight's
+// worth of items per round, and with a single tenant this is a plain FIFO queue.
+// A tenant's bookkeeping is released once it has no items, except for the default tenant 0,
+// which keeps its storage so that the single-tenant case does not allocate. Not thread-safe.
+template <class Item>
+class FairQueue
+{
+public:
+    FairQueue() : _count(0), _lastFlow(nullptr) { }
+
+    bool IsEmpty() const
+    {
+        return _count == 0;
+    }
+
+    size_t Size() const
+    {
+        return _count;
+    }
+
+    // Gets the next item: the oldest item of the tenant whose turn it is.
+    Item& Front()
+    {
+        return _activeFlows.Front()->items.Front();
+    }
+
+    size_t FrontTenant() const
+    {
+        return _activeFlows.Front()->tenant;
+    }
+
+    // Adds an item to the back of the tenant's queue. The weight (treated as 1 if 0) applies
+    // from the tenant's next turn.
+    template <typename ItemType>
+    void Push(size_t tenant, unsigned int weight, ItemType&& item)
+    {
+        Flow& flow = GetFlow(tenant);
+        flow.weight = (weight != 0 ? weight : 1);
+        if (flow.items.IsEmpty())
+        {
+            flow.credit = flow.weight;
+            _activeFlows.Push(&flow);
+        }
+
+        flow.items.Push(std::forward<ItemType>(item));
+        _count++;
+    }
+
+    // Removes the front item, and moves on to the next tenant if this one has used up its turn.
+    void Pop()
+    {
+        Flow* flow = _activeFlows.Front();
+        flow->items.Pop();
+        _count--;
+
+        if (flow->items.IsEmpty())
+        {
+            _activeFlows.Pop();
+            ReleaseFlow(flow);
+        }
+        else if (--flow->credit == 0)
+        {
+            flow->credit = flow->weight;
+            _activeFlows.Pop();
+            _activeFlows.Push(flow);
+        }
+    }
+
+    void Clear()
+    {
+        for (size_t i = 0; i < _activeFlows.Size(); i++)
+        {
+            _activeFlows[i]->items.Clear();
+            ReleaseFlow(_activeFlows[i]);
+        }
+
+        _activeFlows.Clear();
+        _count = 0;
+    }
+
+    // Removes the first item that satisfies the predicate, looking first in the queue of the
+    // tenant with the most items, so that under overload the heaviest tenant sheds its own work.
+    template <typename Predicate>
+    bool RemoveFirst(Predicate predicate, Item& removedItem, size_t& tenant)
+    {
+        size_t longest = 0;
+        for (size_t i = 1; i < _activeFlows.Size(); i++)
+        {
+            if (_activeFlows[i]->items.Size() > _activeFlows[longest]->items.Size())
+            {
+                longest = i;
+            }
+        }
+
+        for (size_t i = 0; i < _activeFlows.Size(); i++)
+        {
+            size_t index = (i == 0 ? longest : (i <= longest ? i - 1 : i));
+            Flow* flow = _activeFlows[index];
+            if (flow->items.RemoveFirst(predicate, removedItem))
+            {
+                tenant = flow->tenant;
+                _count--;
+                if (flow->items.IsEmpty())
+                {
+                    _activeFlows.RemoveAt(index);
+                    ReleaseFlow(flow);
+                }
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+private:
+    FairQueue(const FairQueue&) = delete;
+    FairQueue& operator=(const FairQueue&) = delete;
+
+    struct Flow
+    {
+        Flow() : tenant(0), weight(1), credit(0) { }
+
+        size_t tenant;
+        unsigned int weight;
+
+        // Items left in the tenant's current turn.
+        unsigned int credit;
+
+        RingQueue<Item> items;
+    };
+
+    Flow& GetFlow(size_t tenant)
+    {
+        // Usually the same tenant pushes many items in a row.
+        if (_lastFlow == nullptr || _lastFlow->tenant != tenant)
+        {
+            // Elements of an unordered_map never move, so _activeFlows can point at them.
+            _lastFlow = &_flows[tenant];
+            _lastFlow->tenant = tenant;
+        }
+
+        return *_lastFlow;
+    }
+
+    // Forgets a tenant that has no items left, so that tenant keys that come and go (such as
+    // per-device keys) do not accumulate, each with its queue's peak storage.
+    void ReleaseFlow(Flow* flow)
+    {
+        if (flow->tenant != 0)
+        {
+            if (_lastFlow == flow)
+            {
+                _lastFlow = nullptr;
+            }
+
+            _flows.erase(flow->tenant);
+        }
+    }
+
+    std::unordered_map<size_t, Flow> _flows;
+
+    // Tenants with items, in turn order; the front one is taking its turn. A RingQueue keeps its
+    // storage, so tenants taking turns do not allocate.
+    RingQueue<Flow*> _activeFlows;
+
+    size_t _count;
+    Flow* _lastFlow;
+};
+
+}
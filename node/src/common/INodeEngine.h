@@ -2,6 +2,64 @@
 namespace OpenT2T
 {
 
+/// Relative scheduling priority of a script call. Queued calls with a higher priority run
+/// first, although long-waiting lower-priority calls are eventually promoted so they cannot
+/// be starved indefinitely.
+enum class CallPriority
+{
+    /// Latency-sensitive calls, e.g. in response to a user action.
+    Interactive,
+
+    /// The default priority.
+    Normal,
+
+    /// Bulk or periodic work such as background polling.
+    Background,
+};
+
+/// Options that control how a CallScript request is scheduled.
+struct CallScriptOptions
+{
+    CallScriptOptions(CallPriority priority = CallPriority::Normal, size_t tenant = 0) :
+        priority(priority),
+        tenant(tenant),
+        affinityKey(0)
+    {
+    }
+
+    CallPriority priority;
+
+    /// Identifies the client (such as a device integration) the call is made for, when several
+    /// share one engine. Engines that support it share time fairly between tenants with calls
+    /// waiting at the same priority, so one busy tenant cannot starve the rest.
+    size_t tenant;
+
+    /// Identifies state that the call's script keeps in the engine, such as a device's module
+    /// instance, for engines that spread calls over several script contexts: calls with the same
+    /// nonzero key always run in the same context. Zero (the default) lets the engine choose.
+    size_t affinityKey;
+
+    /// Lets the caller cancel the call (or batch of calls) while it is still queued, for example
+    /// when the screen or device it was for goes away. A cancelled call does not run; its callback
+    /// is invoked with a CancelledError instead. Calls that have started are not affected.
+    CancellationToken cancellationToken;
+};
+
+/// A script call and its result callback, as submitted in a batch to CallScriptBatch.
+struct ScriptCall
+{
+    ScriptCall(
+        std::string scriptCode,
+        std::function<void(std::string resultJson, std::exception_ptr ex)> callback) :
+        scriptCode(std::move(scriptCode)),
+        callback(std::move(callback))
+    {
+    }
+
+    std::string scriptCode;
+    std::function<void(std::string resultJson, std::exception_ptr ex)> callback;
+};
+
 /// Defines a minimal interface to a hosted Node.js engine required by OpenT2T.
 /// Includes methods for initializing, starting, and stopping the Node.js environment,
 /// as well as calling back and forth between C++ and JavaScript. For simplicity,
@@ -17,6 +75,12 @@ public:
     virtual void DefineScriptFile(
         std::string scriptFileName, std::string scriptCode) = 0;
 
+    /// Injects the script files in a bundle file, as if each were defined with DefineScriptFile,
+    /// but without reading them up front: a script is read from the bundle and defined when it
+    /// is first required. For scripts with the same name, the last bundle defined wins. Throws
+    /// if the bundle file cannot be opened or is not valid. See ScriptBundle for the format.
+    virtual void DefineScriptBundle(std::string bundlePath) = 0;
+
     /// Asynchronously starts the node engine, specifying the the working directory that
     /// node modules will be loaded relative to. The callback is invoked when starting
     /// completes; if starting failed, the callback exception argument is non-null.
@@ -34,16 +98,74 @@ public:
     /// to the working directory. The callback is invoked with the result of the evaluation
     /// (in JSON format); if evaluation failed or threw an error, the callback exception
     /// argument is non-null. The callback exception includes the message property from
-    /// the JavaScript error object, if any.
+    /// the JavaScript error object, if any. If the expression evaluates to a promise, the
+    /// callback is invoked when the promise settles, with the value it resolved to or the
+    /// error it was rejected with.
+    virtual void CallScript(
+        std::string scriptCode,
+        std::function<void(std::string resultJson, std::exception_ptr ex)> callback) = 0;
+
+    /// Same as CallScript above, with options such as the priority of the call.
     virtual void CallScript(
         std::string scriptCode,
+        const CallScriptOptions& options,
         std::function<void(std::string resultJson, std::exception_ptr ex)> callback) = 0;
 
+    /// Asynchronously evaluates a batch of script calls, in order, as if by calling CallScript
+    /// for each one. The batch is queued and evaluated as a whole, which is cheaper than separate
+    /// calls when issuing many at once. Each call's callback is invoked with that call's result;
+    /// calls that cannot be queued because the engine is overloaded fail via their callback.
+    virtual void CallScriptBatch(
+        std::vector<ScriptCall> calls,
+        const CallScriptOptions& options) = 0;
+
     /// Registers a global callback function that can be invoked by JavaScript. The
     /// arguments passed to the callback function are formatted as a JSON array.
     virtual void RegisterCallFromScript(
         std::string scriptFunctionName,
         std::function<void(std::string argsJson)> callback) = 0;
+
+    /// Same as RegisterCallFromScript above, but passes the arguments to the callback as values
+    /// (converted as CallFunction converts results) rather than formatting them as JSON, which
+    /// is cheaper for frequent calls such as notifications.
+    virtual void RegisterTypedCallFromScript(
+        std::string scriptFunctionName,
+        std::function<void(std::vector<NodeValue> args)> callback) = 0;
+
+    /// Removes a global callback function registered with RegisterCallFromScript,
+    /// RegisterTypedCallFromScript or RegisterBufferCallFromScript, and releases the callback.
+    /// Script that calls the function afterwards fails as if it was never defined.
+    virtual void UnregisterCallFromScript(std::string scriptFunctionName) = 0;
+
+    /// Asynchronously passes binary data to script without converting it to JSON. The script
+    /// code must evaluate to a function, which is called with the data as a Buffer and must
+    /// return a Buffer (or null), or a promise of one. The callback is invoked with the
+    /// returned Buffer's contents; errors are reported as for CallScript.
+    virtual void CallScriptWithBuffer(
+        std::string scriptCode,
+        std::vector<uint8_t> data,
+        const CallScriptOptions& options,
+        std::function<void(std::vector<uint8_t> resultData, std::exception_ptr ex)> callback) = 0;
+
+    /// Registers a global callback function that JavaScript can invoke with binary data. The
+    /// function's argument is passed to the callback as the contents of a Buffer, or if it is a
+    /// string, as its UTF-8 bytes.
+    virtual void RegisterBufferCallFromScript(
+        std::string scriptFunctionName,
+        std::function<void(std::vector<uint8_t> data)> callback) = 0;
+
+    /// Asynchronously calls a function exported by a module, as if by evaluating
+    /// require(moduleName)[functionName](args...) with the module as "this", but without
+    /// formatting the call as script code or its arguments and result as JSON. Numbers, booleans
+    /// and strings are passed through as they are; a result that is an array or object is
+    /// returned as a Json value, and undefined as null. Promises and errors are handled as for
+    /// CallScript.
+    virtual void CallFunction(
+        std::string moduleName,
+        std::string functionName,
+        std::vector<NodeValue> args,
+        const CallScriptOptions& options,
+        std::function<void(NodeValue result, std::exception_ptr ex)> callback) = 0;
 };
 
 }
\ No newline at end of file
@@ -1,17 +1,43 @@
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <functional>
+#include <iterator>
+#include <list>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <new>
 #include <queue>
+#include <stdexcept>
 #include <string>
 #include <thread>
+#include <type_traits>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "Log.h"
+#include "CancellationToken.h"
+#include "NodeValue.h"
 #include "INodeEngine.h"
+#include "ThreadOptions.h"
+#include "MpscQueue.h"
+#include "RingQueue.h"
+#include "FairQueue.h"
 #include "AsyncQueue.h"
+#include "UniqueFunction.h"
 #include "WorkItemDispatcher.h"
+#include "ThreadPool.h"
+#include "LruCache.h"
+#include "SlotTable.h"
+#include "ScriptBundle.h"
 #include "JXCoreEngine.h"
 
 #include "jxcore/jx.h"
@@ -20,6 +46,11 @@ using namespace OpenT2T;
 
 const char* mainScriptFileName = "main.js";
 
+/// Bounds on how often the engine thread polls the JXCore event loop while it has pending work
+/// (such as timers or I/O) and no script calls are arriving.
+const std::chrono::milliseconds MinEventLoopPollInterval(1);
+const std::chrono::milliseconds MaxEventLoopPollInterval(20);
+
 /// JavaScript contents of the "main.js" script for JXCore. It doesn't do much; most execution should be
 /// driven by defining additional named script files and directly evaluating script code strings.
 const char* mainScriptCode =
@@ -37,21 +68,212 @@ const char* mainScriptCode =
     "console.log('JXCore: Loaded main.js.');"
     ;
 
-/// JavaScript code for a function that evaluates the caller's script code and returns the result (or error)
-/// via a callback.
+/// JavaScript code for a function that evaluates the caller's script code, or calls the function it was compiled
+/// into, and returns the result (or error) via a callback. If the result is a promise (or any "thenable"), the
+/// callback is invoked when it settles, with the value it resolves to (or the error it rejects with).
 const char* callScriptFunctionCode =
-    "(function (callId, scriptCode) {"
-    "var resultJson;"
+    "(function (callId, script) {"
+        "function complete(result) {"
+            "var resultJson;"
+            "try {"
+                "resultJson = JSON.stringify(result);"
+            "} catch (e) {"
+                "process.natives.jxerror(callId, e);"
+                "return;"
+            "}"
+            "process.natives.jxresult(callId, resultJson);"
+        "}"
+        "function fail(e) {"
+            "process.natives.jxerror(callId, (e != null ? e : {}));"
+        "}"
+        "var result;"
+        "try {"
+            "result = (typeof script === 'function' ? script() : eval(script));"
+        "} catch (e) {"
+            "fail(e);"
+            "return;"
+        "}"
+        "if (result != null && typeof result.then === 'function') {"
+            "result.then(complete, fail);"
+        "} else {"
+            "complete(result);"
+        "}"
+    "})";
+
+/// JavaScript code for a function that evaluates an array of scripts (script code or compiled functions) like the
+/// function above, and returns all their results (JSON, or undefined for a script that threw) and errors (undefined
+/// for a script that did not throw) via one callback. A script that returns a promise gets a null result instead,
+/// and its own callback via the result or error callback when the promise settles. Scripts are evaluated in a nested
+/// function so that variables they declare cannot interfere with the loop.
+const char* callScriptBatchFunctionCode =
+    "(function (callIds, scripts) {"
+        "function evaluate(script) {"
+            "return (typeof script === 'function' ? script() : eval(script));"
+        "}"
+        "function settle(callId, promise) {"
+            "promise.then(function (result) {"
+                "var resultJson;"
+                "try {"
+                    "resultJson = JSON.stringify(result);"
+                "} catch (e) {"
+                    "process.natives.jxerror(callId, e);"
+                    "return;"
+                "}"
+                "process.natives.jxresult(callId, resultJson);"
+            "}, function (e) {"
+                "process.natives.jxerror(callId, (e != null ? e : {}));"
+            "});"
+        "}"
+        "var resultJsons = new Array(scripts.length);"
+        "var errors = new Array(scripts.length);"
+        "for (var i = 0; i < scripts.length; i++) {"
+            "try {"
+                "var result = evaluate(scripts[i]);"
+                "if (result != null && typeof result.then === 'function') {"
+                    "resultJsons[i] = null;"
+                    "settle(callIds[i], result);"
+                "} else {"
+                    "resultJsons[i] = JSON.stringify(result);"
+                "}"
+            "} catch (e) {"
+                "errors[i] = (e != null ? e : {});"
+            "}"
+        "}"
+        "process.natives.jxbatchresult(callIds, resultJsons, errors);"
+    "})";
+
+/// JavaScript code for a function that evaluates the caller's script code (or calls the function it was compiled
+/// into) to get a function, calls that with a Buffer, and returns the Buffer it returns via a callback like the
+/// function above. A null or undefined result is returned as an empty Buffer. The data argument is undefined when
+/// there is no data, since JX_SetBuffer cannot create an empty Buffer.
+const char* callScriptWithBufferFunctionCode =
+    "(function (callId, script, data) {"
+        "function complete(result) {"
+            "if (result == null) {"
+                "result = new Buffer(0);"
+            "} else if (!Buffer.isBuffer(result)) {"
+                "process.natives.jxerror(callId, new TypeError('Script result is not a Buffer.'));"
+                "return;"
+            "}"
+            "process.natives.jxresult(callId, result);"
+        "}"
+        "function fail(e) {"
+            "process.natives.jxerror(callId, (e != null ? e : {}));"
+        "}"
+        "var result;"
+        "try {"
+            "var scriptFunction = (typeof script === 'function' ? script() : eval(script));"
+            "result = scriptFunction(data !== undefined ? data : new Buffer(0));"
+        "} catch (e) {"
+            "fail(e);"
+            "return;"
+        "}"
+        "if (result != null && typeof result.then === 'function') {"
+            "result.then(complete, fail);"
+        "} else {"
+            "complete(result);"
+        "}"
+    "})";
+
+/// JavaScript code for a function that calls a function exported by a module with the remaining arguments, and
+/// returns the result via a callback like the functions above, without converting it to JSON. The native side
+/// converts the result value, or gets an object's JSON from the engine.
+const char* callFunctionFunctionCode =
+    "(function (callId, moduleName, functionName) {"
+        "function complete(result) {"
+            "process.natives.jxresult(callId, result);"
+        "}"
+        "function fail(e) {"
+            "process.natives.jxerror(callId, (e != null ? e : {}));"
+        "}"
+        "var result;"
         "try {"
-            "var result = eval(scriptCode);"
-            "resultJson = JSON.stringify(result);"
+            "var moduleExports = require(moduleName);"
+            "if (typeof moduleExports[functionName] !== 'function') {"
+                "throw new TypeError(\"Module '\" + moduleName + \"' has no function '\" + functionName + \"'.\");"
+            "}"
+            "result = moduleExports[functionName].apply(moduleExports, Array.prototype.slice.call(arguments, 3));"
         "} catch (e) {"
-            "process.natives.jxerror(callId, e);"
+            "fail(e);"
             "return;"
         "}"
-        "process.natives.jxresult(callId, resultJson);"
+        "if (result != null && typeof result.then === 'function') {"
+            "result.then(complete, fail);"
+        "} else {"
+            "complete(result);"
+        "}"
+    "})";
+
+/// JavaScript code for a function that compiles the caller's script code, if it is a single expression (ignoring
+/// trailing semicolons), into a function that returns its value. Returns null for script code that eval might treat
+/// differently: code that is not an expression, code that only parses once it is wrapped in parentheses (such as
+/// "1)+(2"), and code that eval would parse as a statement, such as "{a:1}" (a block) or a function declaration.
+const char* compileScriptFunctionCode =
+    "(function (scriptCode) {"
+        "var code = scriptCode.replace(/[\\s;]+$/, '');"
+        "var start = code.replace(/^(\\s|\\/\\/[^\\n]*(\\n|$)|\\/\\*[\\s\\S]*?\\*\\/)*/, '');"
+        "if (/^(\\{|function\\b|class\\b|let\\b|async\\s+function\\b)/.test(start)) {"
+            "return null;"
+        "}"
+        "try {"
+            "new Function(code);"
+            "return new Function('return (' + code + '\\n);');"
+        "} catch (e) {"
+            "return null;"
+        "}"
+    "})";
+
+/// JavaScript code that wraps require to define bundled scripts the first time they are required, and returns a
+/// function that adds the names of bundled scripts (not yet defined) from an array.
+const char* bundledScriptLoaderCode =
+    "(function () {"
+        "var bundledScripts = Object.create(null);"
+        "var moduleRequire = module.constructor.prototype.require;"
+        "module.constructor.prototype.require = function (id) {"
+            "if (typeof id === 'string' && bundledScripts[id] === true) {"
+                "delete bundledScripts[id];"
+                "process.natives.jxdefinebundledscript(id);"
+            "}"
+            "return moduleRequire.apply(this, arguments);"
+        "};"
+        "return function (scriptNames) {"
+            "scriptNames.forEach(function (scriptName) { bundledScripts[scriptName] = true; });"
+        "};"
+    "})()";
+
+/// JavaScript code for a function that requires a module when prewarming, returning whether it could be required.
+const char* prewarmModuleFunctionCode =
+    "(function (moduleName) {"
+        "try {"
+            "require(moduleName);"
+            "return true;"
+        "} catch (e) {"
+            "return false;"
+        "}"
+    "})";
+
+/// JavaScript code for a function that creates a global function to be called from script, which passes the ID of its
+/// registration and its arguments to the shared native method. Used for registrations beyond the native methods that
+/// registered functions are bound to directly.
+const char* createCallFromScriptFunctionCode =
+    "(function (callId) {"
+        "return function () {"
+            "var args = Array.prototype.slice.call(arguments);"
+            "args.unshift(callId);"
+            "process.natives.jxcallfromscript.apply(null, args);"
+        "};"
     "})";
 
+/// Gets a value as a string (for an object, its JSON), or an empty string if it has none. JX_GetString returns a copy,
+/// which is freed here.
+std::string GetStringValue(JXValue* value)
+{
+    char* stringValue = (value != nullptr ? JX_GetString(value) : nullptr);
+    std::string result = (stringValue != nullptr ? std::string(stringValue) : std::string());
+    std::free(stringValue);
+    return result;
+}
+
 /// Callback invoked by JavaScript calls to console.log (overridden by main.js).
 void JXLogCallback(JXValue* argv, int argc)
 {
@@ -62,123 +284,445 @@ void JXLogCallback(JXValue* argv, int argc)
     }
 
     LogSeverity severity = static_cast<LogSeverity>(JX_GetInt32(argv));
-    const char* message = JX_GetString(argv + 1);
-    Log(severity, message);
+    Log(severity, GetStringValue(argv + 1).c_str());
 }
 
-/// Callback invoked with the result of evaluation of caller's JavaScript code.
-void JXResultCallback(JXValue* argv, int argc)
+/// Converts a JavaScript Error object to a std::runtime_error with the same message.
+std::exception_ptr CreateScriptException(JXValue* error)
 {
-    if (argc != 2)
+    // Get the message property from the JavaScript Error object, if available.
+    JXValue errorMessageValue;
+    JX_New(&errorMessageValue);
+    JX_GetNamedProperty(error, "message", &errorMessageValue);
+    std::string errorMessage = GetStringValue(&errorMessageValue);
+    JX_Free(&errorMessageValue);
+
+    LogTrace("Script error: \"%s\"", errorMessage.c_str());
+
+    return std::make_exception_ptr(
+        !errorMessage.empty() ? std::runtime_error(errorMessage) : std::runtime_error("Unknown script error."));
+}
+
+/// Gets the JSON string of a script call's result value, or an empty string if there is none.
+std::string GetResultJson(JXValue* result)
+{
+    return (result != nullptr && JX_IsString(result) ? GetStringValue(result) : std::string());
+}
+
+/// Copies the contents of a Buffer out of the JavaScript heap, where it may be moved or collected.
+/// Returns an empty vector if the value is not a Buffer.
+std::vector<uint8_t> GetBufferData(JXValue* buffer)
+{
+    if (buffer == nullptr || !JX_IsBuffer(buffer))
     {
-        LogWarning("Invalid result callback.");
-        return;
+        return std::vector<uint8_t>();
     }
 
-    const char* callIdHex = JX_GetString(argv);
-    unsigned long long callId = std::strtoull(callIdHex, nullptr, 16);
-    if (callId == 0)
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(JX_GetBuffer(buffer));
+    int32_t length = JX_GetDataLength(buffer);
+    return (data != nullptr && length > 0 ? std::vector<uint8_t>(data, data + length) : std::vector<uint8_t>());
+}
+
+/// Sets a JXValue to a native value. Arrays and objects are built element by element.
+void SetNodeValue(JXValue* value, const NodeValue& nodeValue)
+{
+    switch (nodeValue.GetType())
     {
-        LogWarning("Invalid result callback ID.");
-        return;
+    case NodeValueType::Boolean:
+        JX_SetBoolean(value, nodeValue.GetBoolean());
+        break;
+    case NodeValueType::Int32:
+        JX_SetInt32(value, nodeValue.GetInt32());
+        break;
+    case NodeValueType::Double:
+        JX_SetDouble(value, nodeValue.GetDouble());
+        break;
+    case NodeValueType::String:
+        JX_SetString(value, nodeValue.GetString().c_str(), static_cast<int32_t>(nodeValue.GetString().size()));
+        break;
+    case NodeValueType::Json:
+        JX_SetJSON(value, nodeValue.GetJson().c_str(), static_cast<int32_t>(nodeValue.GetJson().size()));
+        break;
+    case NodeValueType::Array:
+    {
+        const std::vector<NodeValue>& items = nodeValue.GetArray();
+        JX_CreateArrayObject(value);
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            JXValue item;
+            JX_New(&item);
+            SetNodeValue(&item, items[i]);
+            JX_SetIndexedProperty(value, static_cast<unsigned>(i), &item);
+            JX_Free(&item);
+        }
+        break;
+    }
+    case NodeValueType::Object:
+    {
+        JX_CreateEmptyObject(value);
+        for (const std::pair<const std::string, NodeValue>& property : nodeValue.GetObject())
+        {
+            JXValue propertyValue;
+            JX_New(&propertyValue);
+            SetNodeValue(&propertyValue, property.second);
+            JX_SetNamedProperty(value, property.first.c_str(), &propertyValue);
+            JX_Free(&propertyValue);
+        }
+        break;
+    }
+    case NodeValueType::Null:
+    default:
+        JX_SetNull(value);
+        break;
+    }
+}
+
+/// Converts a script call's result value to a native value. Strings and objects are copied out of the engine (an
+/// object as its JSON); undefined, functions and other values that have no native equivalent become null.
+NodeValue GetNodeValue(JXValue* value)
+{
+    if (value == nullptr || JX_IsNullOrUndefined(value))
+    {
+        return NodeValue();
+    }
+    else if (JX_IsBoolean(value))
+    {
+        return NodeValue(JX_GetBoolean(value));
+    }
+    else if (JX_IsInt32(value))
+    {
+        return NodeValue(JX_GetInt32(value));
+    }
+    else if (JX_IsDouble(value))
+    {
+        return NodeValue(JX_GetDouble(value));
+    }
+
+    bool isString = JX_IsString(value);
+    if (!isString && !JX_IsObject(value) && !JX_IsJSON(value))
+    {
+        return NodeValue();
     }
 
-    const char* resultJson = JX_GetString(argv + 1);
+    std::string result = GetStringValue(value);
+    return (isString ? NodeValue(std::move(result)) : NodeValue::Json(std::move(result)));
+}
 
-    LogTrace("JXResultCallback(\"%s\", \"%s\")", callIdHex, resultJson);
+/// Result callback of a script call that converts the result value, while it is valid, and passes it on. The callback
+/// is moved in, so creating one for a call does not copy (or allocate for) the caller's callback.
+template <typename ResultType>
+struct ConvertedResultCallback
+{
+    std::function<void(ResultType result, std::exception_ptr ex)> callback;
+    ResultType (*convert)(JXValue* result);
 
-    std::function<void(std::string, std::exception_ptr)>* callbackPtr =
-        reinterpret_cast<std::function<void(std::string, std::exception_ptr)>*>(callId);
-    try
+    void operator()(void* result, std::exception_ptr ex)
     {
-        // Since this was a successful evaluation, the first parameter passed to the callback is the
-        // JSON result of the evaluation, and the second parameter (exception) is null.
-        (*callbackPtr)(resultJson ? std::string(resultJson) : std::string(), nullptr);
+        callback(convert(reinterpret_cast<JXValue*>(result)), ex);
     }
-    catch (...)
+};
+
+template <typename ResultType>
+ConvertedResultCallback<ResultType> ConvertResult(
+    std::function<void(ResultType result, std::exception_ptr ex)>& callback,
+    ResultType (*convert)(JXValue* result))
+{
+    ConvertedResultCallback<ResultType> resultCallback = { std::move(callback), convert };
+    return resultCallback;
+}
+
+/// The engine that runs on this thread, for callbacks from JavaScript, which JXCore invokes without any context.
+thread_local JXCoreEngine* currentEngine = nullptr;
+
+/// Callback invoked with the result of evaluation of caller's JavaScript code.
+void JXCoreEngine::JXResultCallback(void* argv, int argc)
+{
+    JXValue* args = reinterpret_cast<JXValue*>(argv);
+    if (argc != 2 || currentEngine == nullptr)
     {
-        LogWarning("Script result callback function threw an exception.");
+        LogWarning("Invalid result callback.");
+        return;
     }
 
-    delete callbackPtr;
+    int32_t callId = JX_GetInt32(args);
+
+    LogTrace("JXResultCallback(%d)", callId);
+
+    // Since this was a successful evaluation, the result passed to the callback is the result value
+    // (JSON, a Buffer, or a value of any type for a function call), and the exception is null.
+    currentEngine->CompleteInFlightCall(callId, args + 1, nullptr);
 }
 
 /// Callback invoked when evaluation of caller's JavaScript code threw an error.
-void JXErrorCallback(JXValue* argv, int argc)
+void JXCoreEngine::JXErrorCallback(void* argv, int argc)
 {
-    if (argc != 2)
+    JXValue* args = reinterpret_cast<JXValue*>(argv);
+    if (argc != 2 || currentEngine == nullptr)
     {
         LogWarning("Invalid error callback.");
         return;
     }
 
-    const char* callIdHex = JX_GetString(argv);
-    unsigned long long callId = std::strtoull(callIdHex, nullptr, 16);
-    if (callId == 0)
+    int32_t callId = JX_GetInt32(args);
+
+    LogTrace("JXErrorCallback(%d)", callId);
+
+    // Since this was a failed evaluation, the result passed to the callback is null, and the exception
+    // is the script error.
+    currentEngine->CompleteInFlightCall(callId, nullptr, CreateScriptException(args + 1));
+}
+
+/// Callback invoked when a bundled script is first required, before it is loaded.
+void JXCoreEngine::JXDefineBundledScriptCallback(void* argv, int argc)
+{
+    JXValue* args = reinterpret_cast<JXValue*>(argv);
+    if (argc != 1 || currentEngine == nullptr || !JX_IsString(args))
     {
-        LogWarning("Invalid result callback ID.");
+        LogWarning("Invalid define bundled script callback.");
         return;
     }
 
-    // Get the message property from the JavaScript Error object (2nd argument), if available.
-    JXValue errorMessageValue;
-    JX_New(&errorMessageValue);
-    JX_GetNamedProperty(argv + 1, "message", &errorMessageValue);
-    const char* errorMessage = JX_GetString(&errorMessageValue);
+    currentEngine->DefineBundledScriptInternal(GetStringValue(args));
+}
 
-    LogTrace("JXErrorCallback(\"%s\", \"%s\")", callIdHex, (errorMessage != nullptr ? errorMessage : ""));
+/// Callback invoked by a function registered to be called from script that is not bound to a native method of its own,
+/// with the ID of its registration followed by its arguments.
+void JXCoreEngine::JXCallFromScriptCallback(void* argv, int argc)
+{
+    JXValue* args = reinterpret_cast<JXValue*>(argv);
+    if (argc < 1 || currentEngine == nullptr)
+    {
+        LogWarning("Invalid call callback.");
+        return;
+    }
 
-    std::function<void(std::string, std::exception_ptr)>* callbackPtr =
-        reinterpret_cast<std::function<void(std::string, std::exception_ptr)>*>(callId);
+    currentEngine->InvokeCallFromScript(JX_GetInt32(args), args + 1, argc - 1);
+}
 
-    // Convert the JavaScript Error to a std::runtime_error with the same message.
-    std::exception_ptr ex = std::make_exception_ptr(
-        errorMessage ? std::runtime_error(errorMessage) : std::runtime_error("Unknown script error."));
-    try
+/// Callback invoked with the results and errors of evaluation of a batch of caller's JavaScript code.
+void JXCoreEngine::JXBatchResultCallback(void* argv, int argc)
+{
+    JXValue* args = reinterpret_cast<JXValue*>(argv);
+    if (argc != 3 || currentEngine == nullptr)
     {
-        // Since this was a failed evaluation, the first parameter passed to the callback (the result)
-        // is empty, and the second is the exception pointer.
-        (*callbackPtr)(std::string(), ex);
+        LogWarning("Invalid batch result callback.");
+        return;
     }
-    catch (...)
+
+    JXValue callCountValue;
+    JX_New(&callCountValue);
+    JX_GetNamedProperty(args, "length", &callCountValue);
+    int callCount = JX_GetInt32(&callCountValue);
+    JX_Free(&callCountValue);
+
+    LogTrace("JXBatchResultCallback(%d)", callCount);
+
+    for (int i = 0; i < callCount; i++)
     {
-        LogWarning("Script error callback function threw an exception.");
-    }
+        JXValue callIdValue;
+        JX_New(&callIdValue);
+        JX_GetIndexedProperty(args, i, &callIdValue);
+        int32_t callId = JX_GetInt32(&callIdValue);
+        JX_Free(&callIdValue);
+
+        JXValue error;
+        JX_New(&error);
+        JX_GetIndexedProperty(args + 2, i, &error);
+
+        JXValue result;
+        JX_New(&result);
+        JX_GetIndexedProperty(args + 1, i, &result);
+
+        // A null result means the script returned a promise; its call is completed via the result or
+        // error callback when the promise settles.
+        if (!JX_IsUndefined(&error))
+        {
+            currentEngine->CompleteInFlightCall(callId, nullptr, CreateScriptException(&error));
+        }
+        else if (!JX_IsNull(&result))
+        {
+            currentEngine->CompleteInFlightCall(callId, &result, nullptr);
+        }
 
-    JX_Free(&errorMessageValue);
-    delete callbackPtr;
+        JX_Free(&result);
+        JX_Free(&error);
+    }
 }
 
-/// Callback invoked when JavaScript code calls a function that was registered as a call from script.
-void JXCallCallback(JXValue* argv, int argc)
+/// Appends the JSON for a number, using the fewest digits that read back as the same number, as JSON.stringify does.
+void AppendJsonNumber(std::string& json, double value)
 {
-    if (argc != 2)
+    if (value != value || value - value != 0)
     {
-        LogWarning("Invalid call callback.");
+        // NaN and infinities have no JSON representation.
+        json += "null";
         return;
     }
 
-    const char* callIdHex = JX_GetString(argv);
-    unsigned long long callId = std::strtoull(callIdHex, nullptr, 16);
-    if (callId == 0)
+    char numberBuf[32];
+    for (int precision = 15; precision <= 17; precision++)
     {
-        LogWarning("Invalid result callback ID.");
-        return;
+        snprintf(numberBuf, sizeof(numberBuf), "%.*g", precision, value);
+        if (std::strtod(numberBuf, nullptr) == value)
+        {
+            break;
+        }
+    }
+    json += numberBuf;
+}
+
+void AppendJsonString(std::string& json, const char* value)
+{
+    json += '"';
+    for (const char* c = value; *c != '\0'; c++)
+    {
+        switch (*c)
+        {
+        case '"': json += "\\\""; break;
+        case '\\': json += "\\\\"; break;
+        case '\b': json += "\\b"; break;
+        case '\f': json += "\\f"; break;
+        case '\n': json += "\\n"; break;
+        case '\r': json += "\\r"; break;
+        case '\t': json += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(*c) < 0x20)
+            {
+                char escapeBuf[8];
+                snprintf(escapeBuf, sizeof(escapeBuf), "\\u%04x", static_cast<unsigned int>(*c));
+                json += escapeBuf;
+            }
+            else
+            {
+                json += *c;
+            }
+            break;
+        }
     }
+    json += '"';
+}
 
-    const char* argsJson = JX_GetString(argv + 1);
+/// Formats the arguments of a call from script as a JSON array, as JSON.stringify would. Primitive arguments are
+/// formatted natively; only object arguments are converted to JSON by the engine.
+std::string FormatArgsJson(JXValue* argv, int argc)
+{
+    std::string json = "[";
+    for (int i = 0; i < argc; i++)
+    {
+        if (i > 0)
+        {
+            json += ',';
+        }
 
-    std::function<void(std::string)>* callbackPtr = reinterpret_cast<std::function<void(std::string)>*>(callId);
-    try
+        JXValue* arg = argv + i;
+        if (JX_IsBoolean(arg))
+        {
+            json += (JX_GetBoolean(arg) ? "true" : "false");
+        }
+        else if (JX_IsInt32(arg))
+        {
+            json += std::to_string(JX_GetInt32(arg));
+        }
+        else if (JX_IsDouble(arg))
+        {
+            AppendJsonNumber(json, JX_GetDouble(arg));
+        }
+        else if (JX_IsString(arg) || JX_IsObject(arg) || JX_IsJSON(arg))
+        {
+            // For an object the string value is the object's JSON.
+            std::string stringValue = GetStringValue(arg);
+            if (JX_IsString(arg))
+            {
+                AppendJsonString(json, stringValue.c_str());
+            }
+            else
+            {
+                json += (!stringValue.empty() ? stringValue : "null");
+            }
+        }
+        else
+        {
+            // Like JSON.stringify, null for undefined, functions and other values without JSON.
+            json += "null";
+        }
+    }
+    json += ']';
+    return json;
+}
+
+/// Gets the data passed to a Buffer call from script: a Buffer's contents, or a string's UTF-8 bytes.
+std::vector<uint8_t> GetCallFromScriptData(JXValue* argv, int argc)
+{
+    if (argc < 1 || JX_IsBuffer(argv))
     {
-        (*callbackPtr)(argsJson ? std::string(argsJson) : std::string());
+        return GetBufferData(argc < 1 ? nullptr : argv);
     }
-    catch (...)
+    else if (JX_IsString(argv))
+    {
+        std::string stringValue = GetStringValue(argv);
+        return std::vector<uint8_t>(stringValue.begin(), stringValue.end());
+    }
+
+    LogWarning("Buffer call from script was passed a value that is not a Buffer or string.");
+    return std::vector<uint8_t>();
+}
+
+namespace OpenT2T
+{
+
+/// Native methods that registered call-from-script functions are bound to, one for each of an engine's bindings. JXCore
+/// invokes native methods without any context, so each binding needs its own function; the engine is found via the
+/// thread, and the registration via the binding's index.
+template <size_t Index>
+struct CallFromScriptTrampoline
+{
+    static void Invoke(JXValue* argv, int argc)
+    {
+        if (currentEngine != nullptr && Index < currentEngine->_trampolineCallIds.size())
+        {
+            currentEngine->InvokeCallFromScript(currentEngine->_trampolineCallIds[Index], argv, argc);
+        }
+        else
+        {
+            LogWarning("Invalid call callback.");
+        }
+    }
+};
+
+}
+
+template <size_t Count>
+struct CallFromScriptTrampolines
+{
+    static void Fill(JX_CALLBACK* trampolines)
+    {
+        CallFromScriptTrampolines<Count - 1>::Fill(trampolines);
+        trampolines[Count - 1] = &CallFromScriptTrampoline<Count - 1>::Invoke;
+    }
+};
+
+template <>
+struct CallFromScriptTrampolines<0>
+{
+    static void Fill(JX_CALLBACK*)
     {
-        LogWarning("Script call callback function threw an exception.");
     }
+};
+
+JX_CALLBACK GetCallFromScriptTrampoline(size_t index)
+{
+    struct TrampolineTable
+    {
+        TrampolineTable()
+        {
+            CallFromScriptTrampolines<JXCoreEngine::DirectCallFromScriptCount>::Fill(trampolines);
+        }
+
+        JX_CALLBACK trampolines[JXCoreEngine::DirectCallFromScriptCount];
+    };
 
-    // Don't delete this callback function; it may be invoked multiple times.
+    static const TrampolineTable trampolineTable;
+    return trampolineTable.trampolines[index];
 }
 
 inline void LogErrorAndThrow(const char* message)
@@ -191,90 +735,355 @@ inline void LogErrorAndThrow(const char* message)
 std::once_flag JXCoreEngine::_initOnce;
 std::string JXCoreEngine::_workingDirectory;
 
-JXCoreEngine::JXCoreEngine() :
+JXCoreEngine::JXCoreEngine(
+    const AsyncQueueOptions& dispatcherOptions,
+    const std::shared_ptr<ThreadPool>& callbackThreadPool,
+    const ReentrantDispatchOptions& reentrantOptions,
+    const EnginePrewarmOptions& prewarmOptions) :
+    _dispatcher(GetDispatcherOptions(dispatcherOptions), GetReentrantDispatchOptions(reentrantOptions)),
+    _callbackThreadPool(callbackThreadPool),
     _started(false),
-    _callScriptFunction(nullptr)
+    _startedByPrewarm(false),
+    _pendingCallCount(0),
+    _inFlightCallCount(0),
+    _globalObject(nullptr),
+    _callScriptFunction(nullptr),
+    _callScriptWithBufferFunction(nullptr),
+    _callFunctionFunction(nullptr),
+    _callScriptBatchFunction(nullptr),
+    _compileScriptFunction(nullptr),
+    _addBundledScriptsFunction(nullptr),
+    _createCallFromScriptFunction(nullptr),
+    _scriptCache(DefaultScriptCacheCapacity, FreeCompiledScript),
+    _seenScriptHashes(SeenScriptHashCount),
+    _eventLoopPollInterval(MinEventLoopPollInterval)
 {
+    _dispatcher.SetIdleFunctor(std::bind(&JXCoreEngine::RunEventLoop, this));
     _dispatcher.Initialize();
+
+    if (!prewarmOptions.workingDirectory.empty())
+    {
+        Prewarm(prewarmOptions);
+    }
 }
 
 JXCoreEngine::~JXCoreEngine()
 {
+    // Compiled scripts must be released (and in-flight calls failed) on the engine thread, if the
+    // engine was not stopped. The cleanup is unbounded, so a full queue cannot reject or drop it.
+    bool cleanedUp = false;
+    _dispatcher.DispatchAndWait([this, &cleanedUp]()
+    {
+        FailInFlightCalls();
+        _scriptCache.Clear();
+        cleanedUp = true;
+    }, ControlLane, true);
     _dispatcher.Shutdown();
-}
-
-void JXCoreEngine::DefineScriptFile(std::string scriptFileName, std::string scriptCode)
-{
-    LogTrace("JXCoreEngine::DefineScriptFile(\"%s\", \"...\")", scriptFileName.c_str());
 
-    if (scriptFileName == mainScriptFileName)
+    if (!cleanedUp)
     {
-        throw new std::invalid_argument("Invalid script file name: 'main.js' is a reserved name.");
+        // The engine thread is gone, so nothing else uses the in-flight calls, and failing them
+        // does not touch the engine. The compiled scripts cannot be released off the engine
+        // thread, so they are abandoned.
+        LogWarning("JXCore engine thread stopped before the engine was cleaned up.");
+        FailInFlightCalls();
+        _scriptCache.Abandon();
     }
+}
 
-    _dispatcher.Dispatch([this, scriptFileName, scriptCode]()
+AsyncQueueOptions JXCoreEngine::GetDispatcherOptions(const AsyncQueueOptions& options)
+{
+    AsyncQueueOptions dispatcherOptions = options;
+    dispatcherOptions.laneCount = DispatchLaneCount;
+    if (dispatcherOptions.threadOptions.name.empty())
     {
-        if (!_started)
-        {
-            _initialScriptMap.emplace(scriptFileName, scriptCode);
-        }
-        else
-        {
-            JX_DefineFile(scriptFileName.c_str(), scriptCode.c_str());
-        }
-    });
+        dispatcherOptions.threadOptions.name = "JXCoreEngine";
+    }
+    return dispatcherOptions;
 }
 
-void JXCoreEngine::Start(std::string workingDirectory, std::function<void(std::exception_ptr ex)> callback)
+std::chrono::steady_clock::duration JXCoreEngine::RunEventLoop()
 {
-    LogTrace("JXCoreEngine::Start(\"%s\")", workingDirectory.c_str());
-
-    if (workingDirectory.length() == 0)
+    if (!_started)
     {
-        throw std::invalid_argument("A working directory is required.");
+        return std::chrono::steady_clock::duration::max();
     }
 
-    if (_workingDirectory.length() == 0)
+    if (JX_LoopOnce() == 0)
     {
-        _workingDirectory = workingDirectory;
+        // Nothing is pending (no timers, I/O or other callbacks), so wait for the next call.
+        _eventLoopPollInterval = MinEventLoopPollInterval;
+        return std::chrono::steady_clock::duration::max();
     }
-    else if (workingDirectory != _workingDirectory)
+
+    // JXCore does not expose anything to wait on for the pending work, so poll the loop again,
+    // backing off while it stays pending without any calls in between.
+    std::chrono::steady_clock::duration pollInterval = _eventLoopPollInterval;
+    _eventLoopPollInterval *= 2;
+    if (_eventLoopPollInterval > MaxEventLoopPollInterval)
     {
-        // This limitation of JXCore is not represented in the INodeEngine interface (e.g. as a static
-        // initialization method taking the working directory), because other node engines might not
-        // have the same limitation.
-        LogErrorAndThrow("Cannot start multiple JXCore instances with different working directories.");
+        _eventLoopPollInterval = MaxEventLoopPollInterval;
     }
+    return pollInterval;
+}
+
+void JXCoreEngine::RequestEventLoop()
+{
+    _eventLoopPollInterval = MinEventLoopPollInterval;
+    _dispatcher.RequestIdle();
+}
+
+void JXCoreEngine::Prewarm(const EnginePrewarmOptions& prewarmOptions)
+{
+    LogTrace("JXCoreEngine::Prewarm(\"%s\")", prewarmOptions.workingDirectory.c_str());
+
+    // The engine thread is not running anything yet, so the script files can be added directly.
+    _initialScriptMap.insert(prewarmOptions.scriptFiles.begin(), prewarmOptions.scriptFiles.end());
 
     try
     {
-        std::call_once(_initOnce, [=]()
+        Start(prewarmOptions.workingDirectory, [this](std::exception_ptr ex)
         {
-            JX_InitializeOnce(workingDirectory.c_str());
+            // A failure is left for the app's own Start call to report.
+            _startedByPrewarm = (ex == nullptr);
         });
     }
     catch (...)
     {
-        LogError("Failed to initialize JXCore engine.");
-        throw;
+        // A constructor that throws would leave the dispatcher thread running without an engine.
+        LogWarning("Failed to prewarm JXCore engine.");
+        return;
     }
 
-    _dispatcher.Dispatch([this, callback]()
+    if (!prewarmOptions.modules.empty())
     {
-        try
+        std::vector<std::string> modules = prewarmOptions.modules;
+        _dispatcher.DispatchUnbounded([this, modules]()
         {
-            if (_started)
-            {
-                LogErrorAndThrow("JXCore engine is already started.");
-            }
+            PrewarmModulesInternal(modules);
+        }, BackgroundLane);
+    }
+}
+
+void JXCoreEngine::PrewarmModulesInternal(const std::vector<std::string>& modules)
+{
+    if (!_started)
+    {
+        return;
+    }
+
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    JXValue prewarmModuleFunction;
+    JX_New(&prewarmModuleFunction);
+    JX_Evaluate(prewarmModuleFunctionCode, nullptr, &prewarmModuleFunction);
+
+    size_t prewarmedCount = 0;
+    for (const std::string& moduleName : modules)
+    {
+        JXValue arg;
+        JXValue result;
+        JX_New(&arg);
+        JX_New(&result);
+        JX_SetString(&arg, moduleName.c_str(), static_cast<int32_t>(moduleName.length()));
+
+        if (JX_CallFunction(&prewarmModuleFunction, &arg, 1, &result) && JX_IsBoolean(&result) && JX_GetBoolean(&result))
+        {
+            prewarmedCount++;
+        }
+        else
+        {
+            LogWarning("Failed to prewarm module \"%s\".", moduleName.c_str());
+        }
+
+        JX_Free(&result);
+        JX_Free(&arg);
+    }
+
+    JX_Free(&prewarmModuleFunction);
+
+    // One trivial script call compiles the call-script function and the native result path, which the
+    // modules alone do not reach.
+    _pendingCallCount.fetch_add(1, std::memory_order_relaxed);
+    EvaluateScriptCall("null", nullptr, ResultCallbackType([](void*, std::exception_ptr) { }));
+
+    LogVerbose("Prewarmed %u of %u modules in %d ms.",
+        static_cast<unsigned int>(prewarmedCount),
+        static_cast<unsigned int>(modules.size()),
+        static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - startTime).count()));
+}
+
+ReentrantDispatchOptions JXCoreEngine::GetReentrantDispatchOptions(const ReentrantDispatchOptions& options)
+{
+    // Running a script call inside another would re-enter JX_CallFunction and JX_LoopOnce
+    // from within a native callback, which the JXCore event loop does not support.
+    ReentrantDispatchOptions reentrantOptions = options;
+    if (reentrantOptions.mode == ReentrantDispatchMode::Inline)
+    {
+        LogWarning("JXCore engine does not support inline reentrant calls; using continuations.");
+        reentrantOptions.mode = ReentrantDispatchMode::Continuation;
+    }
+    return reentrantOptions;
+}
+
+void JXCoreEngine::DefineScriptFile(std::string scriptFileName, std::string scriptCode)
+{
+    LogTrace("JXCoreEngine::DefineScriptFile(\"%s\", \"...\")", scriptFileName.c_str());
+
+    if (scriptFileName == mainScriptFileName)
+    {
+        throw new std::invalid_argument("Invalid script file name: 'main.js' is a reserved name.");
+    }
+
+    _dispatcher.DispatchUnbounded([this, scriptFileName, scriptCode]()
+    {
+        if (!_started)
+        {
+            _initialScriptMap.emplace(scriptFileName, scriptCode);
+        }
+        else
+        {
+            JX_DefineFile(scriptFileName.c_str(), scriptCode.c_str());
+        }
+    }, ControlLane);
+}
+
+void JXCoreEngine::DefineScriptBundle(std::string bundlePath)
+{
+    LogTrace("JXCoreEngine::DefineScriptBundle(\"%s\")", bundlePath.c_str());
+
+    std::shared_ptr<const ScriptBundle> scriptBundle = std::make_shared<ScriptBundle>(bundlePath);
+
+    _dispatcher.DispatchUnbounded([this, scriptBundle]()
+    {
+        _scriptBundles.push_back(scriptBundle);
+        if (_started)
+        {
+            AddBundledScriptsInternal(*scriptBundle);
+        }
+    }, ControlLane);
+}
+
+void JXCoreEngine::AddBundledScriptsInternal(const ScriptBundle& scriptBundle)
+{
+    std::string scriptNamesJson = "[";
+    for (const ScriptBundleEntry& entry : scriptBundle.GetEntries())
+    {
+        if (scriptNamesJson.size() > 1)
+        {
+            scriptNamesJson += ',';
+        }
+        AppendJsonString(scriptNamesJson, entry.name.c_str());
+    }
+    scriptNamesJson += ']';
+
+    JXValue scriptNames;
+    JXValue unusedResult;
+    JX_New(&scriptNames);
+    JX_New(&unusedResult);
+    JX_SetJSON(&scriptNames, scriptNamesJson.c_str(), static_cast<int32_t>(scriptNamesJson.size()));
+
+    if (!JX_CallFunction(reinterpret_cast<JXValue*>(_addBundledScriptsFunction), &scriptNames, 1, &unusedResult))
+    {
+        LogError("Failed to add scripts from bundle '%s'.", scriptBundle.GetPath().c_str());
+    }
+
+    JX_Free(&unusedResult);
+    JX_Free(&scriptNames);
+}
+
+void JXCoreEngine::DefineBundledScriptInternal(const std::string& scriptFileName)
+{
+    // Later bundles take precedence.
+    for (size_t i = _scriptBundles.size(); i-- > 0; )
+    {
+        const ScriptBundleEntry* entry = _scriptBundles[i]->FindEntry(scriptFileName);
+        if (entry == nullptr)
+        {
+            continue;
+        }
+
+        try
+        {
+            // The code is copied by JX_DefineFile, so it is only held here while it is defined.
+            std::string scriptCode = _scriptBundles[i]->ReadScript(*entry);
+            JX_DefineFile(scriptFileName.c_str(), scriptCode.c_str());
+            LogVerbose("Defined script file \"%s\" from bundle.", scriptFileName.c_str());
+        }
+        catch (...)
+        {
+            // The error was logged; requiring the script fails as if it were not defined.
+        }
+        return;
+    }
+
+    LogWarning("Bundled script \"%s\" was not found.", scriptFileName.c_str());
+}
+
+void JXCoreEngine::Start(std::string workingDirectory, std::function<void(std::exception_ptr ex)> callback)
+{
+    LogTrace("JXCoreEngine::Start(\"%s\")", workingDirectory.c_str());
+
+    if (workingDirectory.length() == 0)
+    {
+        throw std::invalid_argument("A working directory is required.");
+    }
+
+    if (_workingDirectory.length() == 0)
+    {
+        _workingDirectory = workingDirectory;
+    }
+    else if (workingDirectory != _workingDirectory)
+    {
+        // This limitation of JXCore is not represented in the INodeEngine interface (e.g. as a static
+        // initialization method taking the working directory), because other node engines might not
+        // have the same limitation.
+        LogErrorAndThrow("Cannot start multiple JXCore instances with different working directories.");
+    }
+
+    try
+    {
+        std::call_once(_initOnce, [=]()
+        {
+            JX_InitializeOnce(workingDirectory.c_str());
+        });
+    }
+    catch (...)
+    {
+        LogError("Failed to initialize JXCore engine.");
+        throw;
+    }
+
+    _dispatcher.DispatchUnbounded([this, callback]()
+    {
+        if (_started && _startedByPrewarm)
+        {
+            // The working directory was checked against the prewarm one above.
+            _startedByPrewarm = false;
+            LogVerbose("JXCore engine was already started by prewarming.");
+            callback(nullptr);
+            return;
+        }
+
+        try
+        {
+            if (_started)
+            {
+                LogErrorAndThrow("JXCore engine is already started.");
+            }
 
             JX_InitializeNewEngine();
             JX_DefineMainFile(mainScriptCode);
 
+            // The extensions below are invoked without any context; they find this engine via its thread.
+            currentEngine = this;
             JX_DefineExtension("jxlog", JXLogCallback);
-            JX_DefineExtension("jxcall", JXCallCallback);
-            JX_DefineExtension("jxresult", JXResultCallback);
-            JX_DefineExtension("jxerror", JXErrorCallback);
+            JX_DefineExtension("jxresult", [](JXValue* argv, int argc) { JXResultCallback(argv, argc); });
+            JX_DefineExtension("jxerror", [](JXValue* argv, int argc) { JXErrorCallback(argv, argc); });
+            JX_DefineExtension("jxbatchresult", [](JXValue* argv, int argc) { JXBatchResultCallback(argv, argc); });
+            JX_DefineExtension("jxdefinebundledscript", [](JXValue* argv, int argc) { JXDefineBundledScriptCallback(argv, argc); });
+            JX_DefineExtension("jxcallfromscript", [](JXValue* argv, int argc) { JXCallFromScriptCallback(argv, argc); });
 
             for (const std::pair<std::string, std::string>& scriptEntry : _initialScriptMap)
             {
@@ -283,7 +1092,25 @@ void JXCoreEngine::Start(std::string workingDirectory, std::function<void(std::e
 
             JX_StartEngine();
 
-            for (const std::pair<std::string, std::function<void(std::string)>> callFromScriptEntry : _initialCallFromScriptMap)
+            _globalObject = new JXValue();
+            JX_New(reinterpret_cast<JXValue*>(_globalObject));
+            JX_Evaluate("global", nullptr, reinterpret_cast<JXValue*>(_globalObject));
+
+            // Bundled scripts are not defined here, but when they are first required.
+            _addBundledScriptsFunction = new JXValue();
+            JX_New(reinterpret_cast<JXValue*>(_addBundledScriptsFunction));
+            JX_Evaluate(bundledScriptLoaderCode, nullptr, reinterpret_cast<JXValue*>(_addBundledScriptsFunction));
+            for (const std::shared_ptr<const ScriptBundle>& scriptBundle : _scriptBundles)
+            {
+                AddBundledScriptsInternal(*scriptBundle);
+            }
+
+            _createCallFromScriptFunction = new JXValue();
+            JX_New(reinterpret_cast<JXValue*>(_createCallFromScriptFunction));
+            JX_Evaluate(createCallFromScriptFunctionCode, nullptr, reinterpret_cast<JXValue*>(_createCallFromScriptFunction));
+
+            for (const std::pair<const std::string, std::shared_ptr<const CallFromScript>>& callFromScriptEntry :
+                _initialCallFromScriptMap)
             {
                 this->RegisterCallFromScriptInternal(callFromScriptEntry.first, callFromScriptEntry.second);
             }
@@ -292,6 +1119,22 @@ void JXCoreEngine::Start(std::string workingDirectory, std::function<void(std::e
             JX_New(reinterpret_cast<JXValue*>(_callScriptFunction));
             JX_Evaluate(callScriptFunctionCode, nullptr, reinterpret_cast<JXValue*>(_callScriptFunction));
 
+            _callScriptWithBufferFunction = new JXValue();
+            JX_New(reinterpret_cast<JXValue*>(_callScriptWithBufferFunction));
+            JX_Evaluate(callScriptWithBufferFunctionCode, nullptr, reinterpret_cast<JXValue*>(_callScriptWithBufferFunction));
+
+            _callFunctionFunction = new JXValue();
+            JX_New(reinterpret_cast<JXValue*>(_callFunctionFunction));
+            JX_Evaluate(callFunctionFunctionCode, nullptr, reinterpret_cast<JXValue*>(_callFunctionFunction));
+
+            _callScriptBatchFunction = new JXValue();
+            JX_New(reinterpret_cast<JXValue*>(_callScriptBatchFunction));
+            JX_Evaluate(callScriptBatchFunctionCode, nullptr, reinterpret_cast<JXValue*>(_callScriptBatchFunction));
+
+            _compileScriptFunction = new JXValue();
+            JX_New(reinterpret_cast<JXValue*>(_compileScriptFunction));
+            JX_Evaluate(compileScriptFunctionCode, nullptr, reinterpret_cast<JXValue*>(_compileScriptFunction));
+
             _started = true;
         }
         catch (...)
@@ -301,16 +1144,16 @@ void JXCoreEngine::Start(std::string workingDirectory, std::function<void(std::e
             return;
         }
 
-        LogVerbose("Started JXCore engine.");
+        LogVerbose("Started JXCore engine instance %d.", JX_GetThreadId());
         callback(nullptr);
-    });
+    }, ControlLane);
 }
 
 void JXCoreEngine::Stop(std::function<void(std::exception_ptr ex)> callback)
 {
     LogTrace("JXCoreEngine::Stop()");
 
-    _dispatcher.Dispatch([this, callback]()
+    _dispatcher.DispatchUnbounded([this, callback]()
     {
         try
         {
@@ -319,12 +1162,51 @@ void JXCoreEngine::Stop(std::function<void(std::exception_ptr ex)> callback)
                 LogErrorAndThrow("JXCore engine is not started.");
             }
 
+            FailInFlightCalls();
+            _scriptCache.Clear();
+
+            JX_Free(reinterpret_cast<JXValue*>(_callScriptWithBufferFunction));
+            delete reinterpret_cast<JXValue*>(_callScriptWithBufferFunction);
+            _callScriptWithBufferFunction = nullptr;
+
+            JX_Free(reinterpret_cast<JXValue*>(_callFunctionFunction));
+            delete reinterpret_cast<JXValue*>(_callFunctionFunction);
+            _callFunctionFunction = nullptr;
+
+            JX_Free(reinterpret_cast<JXValue*>(_callScriptBatchFunction));
+            delete reinterpret_cast<JXValue*>(_callScriptBatchFunction);
+            _callScriptBatchFunction = nullptr;
+
+            JX_Free(reinterpret_cast<JXValue*>(_compileScriptFunction));
+            delete reinterpret_cast<JXValue*>(_compileScriptFunction);
+            _compileScriptFunction = nullptr;
+
             JX_Free(reinterpret_cast<JXValue*>(_callScriptFunction));
             delete reinterpret_cast<JXValue*>(_callScriptFunction);
             _callScriptFunction = nullptr;
 
+            JX_Free(reinterpret_cast<JXValue*>(_addBundledScriptsFunction));
+            delete reinterpret_cast<JXValue*>(_addBundledScriptsFunction);
+            _addBundledScriptsFunction = nullptr;
+
+            JX_Free(reinterpret_cast<JXValue*>(_createCallFromScriptFunction));
+            delete reinterpret_cast<JXValue*>(_createCallFromScriptFunction);
+            _createCallFromScriptFunction = nullptr;
+
+            JX_Free(reinterpret_cast<JXValue*>(_globalObject));
+            delete reinterpret_cast<JXValue*>(_globalObject);
+            _globalObject = nullptr;
+
             JX_StopEngine();
             _started = false;
+            _startedByPrewarm = false;
+
+            // Functions registered since the engine started are gone with it.
+            _callsFromScript = SlotTable<std::shared_ptr<const CallFromScript>>();
+            _callFromScriptBindings.clear();
+            _trampolineCallIds.clear();
+            _retiredTrampolineIndexes.clear();
+            currentEngine = nullptr;
         }
         catch (...)
         {
@@ -335,19 +1217,83 @@ void JXCoreEngine::Stop(std::function<void(std::exception_ptr ex)> callback)
 
         LogVerbose("Stopped JXCore engine.");
         callback(nullptr);
-    });
+    }, ControlLane);
 }
 
 void JXCoreEngine::CallScript(
     std::string scriptCode,
     std::function<void(std::string resultJson, std::exception_ptr ex)> callback)
+{
+    this->CallScript(std::move(scriptCode), CallScriptOptions(), std::move(callback));
+}
+
+void JXCoreEngine::CallScript(
+    std::string scriptCode,
+    const CallScriptOptions& options,
+    std::function<void(std::string resultJson, std::exception_ptr ex)> callback)
 {
     LogTrace("JXCoreEngine::CallScript(\"%s\")", scriptCode.c_str());
 
-    _dispatcher.Dispatch([this, scriptCode, callback]()
+    bool dispatched = _dispatcher.DispatchItem(
+        CreateCallScriptWorkItem(std::move(scriptCode), std::move(callback), options.cancellationToken),
+        GetCallScriptLane(options),
+        options.tenant);
+
+    if (!dispatched)
+    {
+        _pendingCallCount.fetch_sub(1, std::memory_order_relaxed);
+        LogWarning("JXCore engine queue is full; rejected script call.");
+        throw std::runtime_error("JXCore engine queue is full.");
+    }
+}
+
+void JXCoreEngine::CallScriptBatch(
+    std::vector<ScriptCall> calls,
+    const CallScriptOptions& options)
+{
+    LogTrace("JXCoreEngine::CallScriptBatch(%u calls)", static_cast<unsigned int>(calls.size()));
+
+    if (calls.empty())
+    {
+        return;
+    }
+
+    for (ScriptCall& call : calls)
+    {
+        call.callback = WrapForCallbackThreadPool(std::move(call.callback));
+    }
+
+    // The whole batch is one work item, evaluated in one call into JavaScript.
+    std::shared_ptr<std::vector<ScriptCall>> batch = std::make_shared<std::vector<ScriptCall>>(std::move(calls));
+    CancellationToken cancellationToken = options.cancellationToken;
+    _pendingCallCount.fetch_add(batch->size(), std::memory_order_relaxed);
+
+    // Invoked instead of the batch if it is cancelled or dropped from a full queue, or if it is rejected.
+    std::function<void()> droppedFunctor = [this, batch, cancellationToken]()
+    {
+        _pendingCallCount.fetch_sub(batch->size(), std::memory_order_relaxed);
+        std::exception_ptr ex = GetDroppedCallException(cancellationToken);
+        for (ScriptCall& call : *batch)
+        {
+            call.callback(std::string(), ex);
+        }
+    };
+
+    bool dispatched = _dispatcher.DispatchItem(
+        WorkItemDispatcher::WorkItem(
+            std::bind(&JXCoreEngine::CallScriptBatchInternal, this, batch),
+            droppedFunctor,
+            cancellationToken),
+        GetCallScriptLane(options),
+        options.tenant);
+
+    if (!dispatched)
     {
-        this->CallScriptInternal(scriptCode, callback);
-    });
+        // Fail the calls via their callbacks rather than throwing, as when a queued batch is dropped.
+        LogWarning("JXCore engine queue is full; rejected a batch of %u script calls.",
+            static_cast<unsigned int>(batch->size()));
+        droppedFunctor();
+    }
 }
 
 void JXCoreEngine::RegisterCallFromScript(
@@ -356,23 +1302,410 @@ void JXCoreEngine::RegisterCallFromScript(
 {
     LogTrace("JXCoreEngine::RegisterCallFromScript(\"%s\")", scriptFunctionName.c_str());
 
-    _dispatcher.Dispatch([this, scriptFunctionName, callback]()
+    CallFromScript callFromScript;
+    callFromScript.callback = WrapForCallbackThreadPool(std::move(callback));
+    DispatchRegisterCallFromScript(std::move(scriptFunctionName), std::move(callFromScript));
+}
+
+void JXCoreEngine::RegisterTypedCallFromScript(
+    std::string scriptFunctionName,
+    std::function<void(std::vector<NodeValue> args)> callback)
+{
+    LogTrace("JXCoreEngine::RegisterTypedCallFromScript(\"%s\")", scriptFunctionName.c_str());
+
+    CallFromScript callFromScript;
+    callFromScript.typedCallback = WrapForCallbackThreadPool(std::move(callback));
+    DispatchRegisterCallFromScript(std::move(scriptFunctionName), std::move(callFromScript));
+}
+
+void JXCoreEngine::DispatchRegisterCallFromScript(std::string scriptFunctionName, CallFromScript callFromScript)
+{
+    // The registration is shared, so a call from script only takes a reference to its callback.
+    std::shared_ptr<const CallFromScript> sharedCallFromScript =
+        std::make_shared<const CallFromScript>(std::move(callFromScript));
+    _dispatcher.DispatchUnbounded([this, scriptFunctionName, sharedCallFromScript]()
     {
         if (!_started)
         {
-            _initialCallFromScriptMap.emplace(scriptFunctionName, callback);
+            _initialCallFromScriptMap[scriptFunctionName] = sharedCallFromScript;
         }
         else
         {
-            this->RegisterCallFromScriptInternal(scriptFunctionName, callback);
+            this->RegisterCallFromScriptInternal(scriptFunctionName, sharedCallFromScript);
         }
-    });
+    }, ControlLane);
 }
 
-void JXCoreEngine::CallScriptInternal(
+void JXCoreEngine::UnregisterCallFromScript(std::string scriptFunctionName)
+{
+    LogTrace("JXCoreEngine::UnregisterCallFromScript(\"%s\")", scriptFunctionName.c_str());
+
+    _dispatcher.DispatchUnbounded([this, scriptFunctionName]()
+    {
+        if (!_started)
+        {
+            _initialCallFromScriptMap.erase(scriptFunctionName);
+        }
+        else
+        {
+            this->UnregisterCallFromScriptInternal(scriptFunctionName);
+        }
+    }, ControlLane);
+}
+
+void JXCoreEngine::CallScriptWithBuffer(
     std::string scriptCode,
-    std::function<void(std::string resultJson, std::exception_ptr ex)> callback)
+    std::vector<uint8_t> data,
+    const CallScriptOptions& options,
+    std::function<void(std::vector<uint8_t> resultData, std::exception_ptr ex)> callback)
+{
+    LogTrace("JXCoreEngine::CallScriptWithBuffer(\"%s\", %u bytes)",
+        scriptCode.c_str(), static_cast<unsigned int>(data.size()));
+
+    if (data.size() > static_cast<size_t>(INT32_MAX))
+    {
+        throw std::invalid_argument("Buffer data is too large.");
+    }
+
+    callback = WrapForCallbackThreadPool(std::move(callback));
+    CancellationToken cancellationToken = options.cancellationToken;
+    _pendingCallCount.fetch_add(1, std::memory_order_relaxed);
+
+    // Invoked instead of the call if it is cancelled, or dropped from a full queue.
+    WorkItemDispatcher::WorkItemFunctorType droppedFunctor = [this, callback, cancellationToken]()
+    {
+        _pendingCallCount.fetch_sub(1, std::memory_order_relaxed);
+        callback(std::vector<uint8_t>(), GetDroppedCallException(cancellationToken));
+    };
+
+    // The data is moved into the work item, so it is not copied until it is put in a Buffer.
+    bool dispatched = _dispatcher.DispatchItem(
+        WorkItemDispatcher::WorkItem(
+            std::bind(&JXCoreEngine::CallScriptWithBufferInternal, this,
+                std::move(scriptCode), std::move(data), std::move(callback)),
+            std::move(droppedFunctor),
+            cancellationToken),
+        GetCallScriptLane(options),
+        options.tenant);
+
+    if (!dispatched)
+    {
+        _pendingCallCount.fetch_sub(1, std::memory_order_relaxed);
+        LogWarning("JXCore engine queue is full; rejected script call.");
+        throw std::runtime_error("JXCore engine queue is full.");
+    }
+}
+
+void JXCoreEngine::RegisterBufferCallFromScript(
+    std::string scriptFunctionName,
+    std::function<void(std::vector<uint8_t> data)> callback)
+{
+    LogTrace("JXCoreEngine::RegisterBufferCallFromScript(\"%s\")", scriptFunctionName.c_str());
+
+    CallFromScript callFromScript;
+    callFromScript.bufferCallback = WrapForCallbackThreadPool(std::move(callback));
+    DispatchRegisterCallFromScript(std::move(scriptFunctionName), std::move(callFromScript));
+}
+
+void JXCoreEngine::CallFunction(
+    std::string moduleName,
+    std::string functionName,
+    std::vector<NodeValue> args,
+    const CallScriptOptions& options,
+    std::function<void(NodeValue result, std::exception_ptr ex)> callback)
+{
+    LogTrace("JXCoreEngine::CallFunction(\"%s\", \"%s\", %u args)",
+        moduleName.c_str(), functionName.c_str(), static_cast<unsigned int>(args.size()));
+
+    callback = WrapForCallbackThreadPool(std::move(callback));
+    CancellationToken cancellationToken = options.cancellationToken;
+    _pendingCallCount.fetch_add(1, std::memory_order_relaxed);
+
+    // Invoked instead of the call if it is cancelled, or dropped from a full queue.
+    WorkItemDispatcher::WorkItemFunctorType droppedFunctor = [this, callback, cancellationToken]()
+    {
+        _pendingCallCount.fetch_sub(1, std::memory_order_relaxed);
+        callback(NodeValue(), GetDroppedCallException(cancellationToken));
+    };
+
+    bool dispatched = _dispatcher.DispatchItem(
+        WorkItemDispatcher::WorkItem(
+            std::bind(&JXCoreEngine::CallFunctionInternal, this,
+                std::move(moduleName), std::move(functionName), std::move(args), std::move(callback)),
+            std::move(droppedFunctor),
+            cancellationToken),
+        GetCallScriptLane(options),
+        options.tenant);
+
+    if (!dispatched)
+    {
+        _pendingCallCount.fetch_sub(1, std::memory_order_relaxed);
+        LogWarning("JXCore engine queue is full; rejected function call.");
+        throw std::runtime_error("JXCore engine queue is full.");
+    }
+}
+
+size_t JXCoreEngine::GetInFlightCallCount() const
+{
+    return _inFlightCallCount.load(std::memory_order_relaxed);
+}
+
+size_t JXCoreEngine::GetPendingCallCount() const
+{
+    return _pendingCallCount.load(std::memory_order_relaxed);
+}
+
+void JXCoreEngine::SetScriptCacheCapacity(size_t capacity)
+{
+    LogTrace("JXCoreEngine::SetScriptCacheCapacity(%u)", static_cast<unsigned int>(capacity));
+
+    _dispatcher.DispatchUnbounded([this, capacity]()
+    {
+        _scriptCache.SetCapacity(capacity);
+    }, ControlLane);
+}
+
+LruCacheStats JXCoreEngine::GetScriptCacheStats() const
+{
+    return _scriptCache.GetStats();
+}
+
+AsyncQueueStats JXCoreEngine::GetQueueStats() const
+{
+    return _dispatcher.GetQueueStats();
+}
+
+void JXCoreEngine::ResetQueueStats()
+{
+    _dispatcher.ResetQueueStats();
+}
+
+void JXCoreEngine::SetTenantWeight(size_t tenant, unsigned int weight)
+{
+    _dispatcher.SetTenantWeight(tenant, weight);
+}
+
+std::vector<AsyncQueueTenantStats> JXCoreEngine::GetTenantStats() const
+{
+    return _dispatcher.GetTenantStats();
+}
+
+JXCoreEngine::DispatchLane JXCoreEngine::GetCallScriptLane(const CallScriptOptions& options)
+{
+    switch (options.priority)
+    {
+    case CallPriority::Interactive:
+        return InteractiveLane;
+    case CallPriority::Background:
+        return BackgroundLane;
+    case CallPriority::Normal:
+    default:
+        return NormalLane;
+    }
+}
+
+WorkItemDispatcher::WorkItem JXCoreEngine::CreateCallScriptWorkItem(
+    std::string scriptCode,
+    std::function<void(std::string resultJson, std::exception_ptr ex)> callback,
+    const CancellationToken& cancellationToken)
+{
+    callback = WrapForCallbackThreadPool(std::move(callback));
+    _pendingCallCount.fetch_add(1, std::memory_order_relaxed);
+
+    // Invoked instead of the call if it is cancelled, or dropped from a full queue.
+    WorkItemDispatcher::WorkItemFunctorType droppedFunctor = [this, callback, cancellationToken]()
+    {
+        _pendingCallCount.fetch_sub(1, std::memory_order_relaxed);
+        callback(std::string(), GetDroppedCallException(cancellationToken));
+    };
+
+    // Bind (rather than a lambda capture, which cannot move in C++11) moves the script code and
+    // callback into the work item. The result fits WorkItemFunctorType's inline buffer, so the
+    // dispatch itself does not allocate.
+    return WorkItemDispatcher::WorkItem(
+        std::bind(&JXCoreEngine::CallScriptInternal, this, std::move(scriptCode), std::move(callback)),
+        std::move(droppedFunctor),
+        cancellationToken);
+}
+
+std::exception_ptr JXCoreEngine::GetDroppedCallException(const CancellationToken& cancellationToken)
 {
+    if (cancellationToken.IsCancelled())
+    {
+        LogVerbose("Skipped cancelled script call.");
+        return std::make_exception_ptr(CancelledError());
+    }
+
+    return std::make_exception_ptr(
+        std::runtime_error("Script call was dropped because the JXCore engine queue is full."));
+}
+
+template <typename... Args>
+std::function<void(Args...)> JXCoreEngine::WrapForCallbackThreadPool(std::function<void(Args...)> callback)
+{
+    if (_callbackThreadPool == nullptr || !callback)
+    {
+        return callback;
+    }
+
+    std::shared_ptr<ThreadPool> threadPool = _callbackThreadPool;
+    return [threadPool, callback](Args... args)
+    {
+        ThreadPool::TaskType task = std::bind(callback, std::move(args)...);
+        if (!threadPool->Submit(std::move(task)))
+        {
+            // The pool has been shut down; don't lose the result.
+            task();
+        }
+    };
+}
+
+void* JXCoreEngine::GetCompiledScript(const std::string& scriptCode)
+{
+    if (_scriptCache.GetCapacity() == 0)
+    {
+        return nullptr;
+    }
+
+    void** cachedScript = _scriptCache.Find(scriptCode);
+    if (cachedScript != nullptr)
+    {
+        return *cachedScript;
+    }
+
+    // Code seen for the first time is evaluated rather than compiled, so one-off scripts (such as
+    // those with literal arguments) do not pay for compiling and caching.
+    size_t scriptHash = std::hash<std::string>()(scriptCode);
+    size_t& seenScriptHash = _seenScriptHashes[scriptHash % SeenScriptHashCount];
+    if (seenScriptHash != scriptHash)
+    {
+        seenScriptHash = scriptHash;
+        return nullptr;
+    }
+
+    seenScriptHash = 0;
+
+    JXValue scriptCodeValue;
+    JX_New(&scriptCodeValue);
+    JX_SetString(&scriptCodeValue, scriptCode.c_str(), static_cast<int>(scriptCode.size()));
+
+    JXValue* compiledScript = new JXValue();
+    JX_New(compiledScript);
+    bool compiled = JX_CallFunction(
+        reinterpret_cast<JXValue*>(_compileScriptFunction), &scriptCodeValue, 1, compiledScript);
+    JX_Free(&scriptCodeValue);
+
+    if (compiled && JX_IsFunction(compiledScript))
+    {
+        // Keep the function alive beyond this call, until it is evicted from the cache.
+        JX_MakePersistent(compiledScript);
+    }
+    else
+    {
+        LogVerbose("Script code is not an expression; it will not be compiled.");
+        JX_Free(compiledScript);
+        delete compiledScript;
+        compiledScript = nullptr;
+    }
+
+    _scriptCache.Insert(scriptCode, compiledScript);
+    return compiledScript;
+}
+
+void JXCoreEngine::SetScriptValue(void* value, const std::string& scriptCode)
+{
+    JXValue* compiledScript = reinterpret_cast<JXValue*>(GetCompiledScript(scriptCode));
+    if (compiledScript != nullptr)
+    {
+        JX_SetObject(reinterpret_cast<JXValue*>(value), compiledScript);
+    }
+    else
+    {
+        JX_SetString(reinterpret_cast<JXValue*>(value), scriptCode.c_str(), static_cast<int>(scriptCode.size()));
+    }
+}
+
+void JXCoreEngine::FreeCompiledScript(void*& compiledScript)
+{
+    if (compiledScript != nullptr)
+    {
+        JX_ClearPersistent(reinterpret_cast<JXValue*>(compiledScript));
+        JX_Free(reinterpret_cast<JXValue*>(compiledScript));
+        delete reinterpret_cast<JXValue*>(compiledScript);
+        compiledScript = nullptr;
+    }
+}
+
+int32_t JXCoreEngine::CreateInFlightCall(ResultCallbackType&& resultCallback)
+{
+    // The call's slot is reused by later calls once it completes, so tracking it does not allocate. If the
+    // table is full this throws, leaving the result callback to the caller.
+    int32_t callId = _inFlightCalls.Insert(std::move(resultCallback));
+    _inFlightCallCount.fetch_add(1, std::memory_order_relaxed);
+    return callId;
+}
+
+void JXCoreEngine::CompleteInFlightCall(int32_t callId, void* result, std::exception_ptr ex)
+{
+    ResultCallbackType resultCallback;
+    if (!_inFlightCalls.Take(callId, resultCallback))
+    {
+        LogWarning("Invalid result callback ID.");
+        return;
+    }
+
+    _inFlightCallCount.fetch_sub(1, std::memory_order_relaxed);
+    _pendingCallCount.fetch_sub(1, std::memory_order_relaxed);
+    try
+    {
+        resultCallback(result, ex);
+    }
+    catch (...)
+    {
+        LogWarning(ex != nullptr ?
+            "Script error callback function threw an exception." :
+            "Script result callback function threw an exception.");
+    }
+}
+
+void JXCoreEngine::FailInFlightCalls()
+{
+    std::vector<int32_t> callIds = _inFlightCalls.GetIds();
+    if (!callIds.empty())
+    {
+        LogWarning("Stopping JXCore engine with %u script calls still waiting for promises.",
+            static_cast<unsigned int>(callIds.size()));
+    }
+
+    std::exception_ptr ex = std::make_exception_ptr(
+        std::runtime_error("JXCore engine was stopped before the script call completed."));
+    for (int32_t callId : callIds)
+    {
+        CompleteInFlightCall(callId, nullptr, ex);
+    }
+}
+
+void JXCoreEngine::CallScriptInternal(
+    const std::string& scriptCode,
+    std::function<void(std::string resultJson, std::exception_ptr ex)>& callback)
+{
+    EvaluateScriptCall(scriptCode, nullptr, ConvertResult(callback, GetResultJson));
+}
+
+void JXCoreEngine::CallScriptWithBufferInternal(
+    const std::string& scriptCode,
+    const std::vector<uint8_t>& data,
+    std::function<void(std::vector<uint8_t> resultData, std::exception_ptr ex)>& callback)
+{
+    EvaluateScriptCall(scriptCode, &data, ConvertResult(callback, GetBufferData));
+}
+
+void JXCoreEngine::EvaluateScriptCall(
+    const std::string& scriptCode,
+    const std::vector<uint8_t>* data,
+    ResultCallbackType resultCallback)
+{
+    int32_t callId = 0;
     try
     {
         if (!_started)
@@ -380,36 +1713,42 @@ void JXCoreEngine::CallScriptInternal(
             LogErrorAndThrow("JXCore engine is not started.");
         }
 
-        std::function<void(std::string, std::exception_ptr)>* callbackPtr =
-        new std::function<void(std::string, std::exception_ptr)>(callback);
+        callId = CreateInFlightCall(std::move(resultCallback));
 
-        // The callback function pointer is passed through JavaScript as a hex-formatted number.
-        unsigned long long callId = reinterpret_cast<unsigned long long>(callbackPtr);
-        char callIdBuf[20];
-        snprintf(callIdBuf, sizeof(callIdBuf), "%llx", callId);
-
-        // Create JXValue arguments to the call-script function: callback pointer and script code string.
-        JXValue args[2];
+        // Create JXValue arguments to the call-script function: call ID, script (the compiled function for
+        // the script code if there is one, otherwise the script code string), and for a call with a Buffer
+        // its data. Creating the Buffer is the only copy of the data on the way in.
+        JXValue args[3];
         JX_New(&args[0]);
         JX_New(&args[1]);
-        JX_SetString(&args[0], callIdBuf);
-        JX_SetString(&args[1], scriptCode.c_str(), static_cast<int>(scriptCode.size()));
+        JX_New(&args[2]);
+        JX_SetInt32(&args[0], callId);
+        SetScriptValue(&args[1], scriptCode);
+        if (data != nullptr && !data->empty())
+        {
+            JX_SetBuffer(&args[2], reinterpret_cast<const char*>(data->data()), static_cast<int32_t>(data->size()));
+        }
 
         JXValue unusedResult;
         JX_New(&unusedResult);
 
         // Invoke the script function that will evaluate the provided script code then callback
-        // via the result or error callback.
-        bool evaluated = JX_CallFunction(reinterpret_cast<JXValue*>(_callScriptFunction), args, 2, &unusedResult);
+        // via the result or error callback, now or when the promise it returned settles.
+        bool evaluated = (data == nullptr ?
+            JX_CallFunction(reinterpret_cast<JXValue*>(_callScriptFunction), args, 2, &unusedResult) :
+            JX_CallFunction(reinterpret_cast<JXValue*>(_callScriptWithBufferFunction), args, 3, &unusedResult));
 
         JX_Free(&unusedResult);
         JX_Free(&args[0]);
         JX_Free(&args[1]);
+        JX_Free(&args[2]);
 
         if (evaluated)
         {
+            // The result or error callback now completes the call.
+            callId = 0;
             LogVerbose("Successfully evaluated script code.");
-            JX_LoopOnce();
+            RequestEventLoop();
         }
         else
         {
@@ -418,51 +1757,326 @@ void JXCoreEngine::CallScriptInternal(
     }
     catch (...)
     {
-        callback(nullptr, std::current_exception());
+        if (callId != 0)
+        {
+            CompleteInFlightCall(callId, nullptr, std::current_exception());
+        }
+        else
+        {
+            _pendingCallCount.fetch_sub(1, std::memory_order_relaxed);
+            resultCallback(nullptr, std::current_exception());
+        }
     }
 }
 
-void JXCoreEngine::RegisterCallFromScriptInternal(
-    std::string scriptFunctionName,
-    std::function<void(std::string argsJson)> callback)
+void JXCoreEngine::CallFunctionInternal(
+    const std::string& moduleName,
+    const std::string& functionName,
+    const std::vector<NodeValue>& args,
+    std::function<void(NodeValue result, std::exception_ptr ex)>& callback)
 {
+    ResultCallbackType resultCallback = ConvertResult(callback, GetNodeValue);
+    int32_t callId = 0;
     try
     {
-        std::function<void(std::string)>* callbackPtr = new std::function<void(std::string)>(callback);
+        if (!_started)
+        {
+            LogErrorAndThrow("JXCore engine is not started.");
+        }
+
+        callId = CreateInFlightCall(std::move(resultCallback));
+
+        // Create JXValue arguments to the call-function function: call ID, module and function names, then
+        // the arguments to the function itself.
+        std::vector<JXValue> functionArgs(3 + args.size());
+        for (JXValue& functionArg : functionArgs)
+        {
+            JX_New(&functionArg);
+        }
+
+        JX_SetInt32(&functionArgs[0], callId);
+        JX_SetString(&functionArgs[1], moduleName.c_str(), static_cast<int32_t>(moduleName.size()));
+        JX_SetString(&functionArgs[2], functionName.c_str(), static_cast<int32_t>(functionName.size()));
+        for (size_t i = 0; i < args.size(); i++)
+        {
+            SetNodeValue(&functionArgs[3 + i], args[i]);
+        }
+
+        JXValue unusedResult;
+        JX_New(&unusedResult);
+
+        bool evaluated = JX_CallFunction(
+            reinterpret_cast<JXValue*>(_callFunctionFunction),
+            functionArgs.data(),
+            static_cast<int>(functionArgs.size()),
+            &unusedResult);
+
+        JX_Free(&unusedResult);
+        for (JXValue& functionArg : functionArgs)
+        {
+            JX_Free(&functionArg);
+        }
+
+        if (evaluated)
+        {
+            // The result or error callback now completes the call.
+            callId = 0;
+            LogVerbose("Successfully called script function.");
+            RequestEventLoop();
+        }
+        else
+        {
+            LogErrorAndThrow("Failed to call script function.");
+        }
+    }
+    catch (...)
+    {
+        if (callId != 0)
+        {
+            CompleteInFlightCall(callId, nullptr, std::current_exception());
+        }
+        else
+        {
+            _pendingCallCount.fetch_sub(1, std::memory_order_relaxed);
+            resultCallback(nullptr, std::current_exception());
+        }
+    }
+}
 
-        // The callback function pointer is passed through JavaScript as a hex-formatted number.
-        unsigned long long callId = reinterpret_cast<unsigned long long>(callbackPtr);
+void JXCoreEngine::CallScriptBatchInternal(const std::shared_ptr<std::vector<ScriptCall>>& batch)
+{
+    std::vector<int32_t> callIds;
+    try
+    {
+        if (!_started)
+        {
+            LogErrorAndThrow("JXCore engine is not started.");
+        }
 
-        // Note the Array.prototype.slice is necessary for proper array JSON-serialization
-        // because arguments is only an array-like object, not actually an array.
-        const char scriptFunctionFormat[] =
-        "function %s() {"
-            "process.natives.jxcall('%llx', JSON.stringify(Array.prototype.slice.call(arguments)));"
-        "}";
+        callIds.reserve(batch->size());
+        for (ScriptCall& call : *batch)
+        {
+            callIds.push_back(CreateInFlightCall(ConvertResult(call.callback, GetResultJson)));
+        }
 
-        size_t scriptBufSize = scriptFunctionName.size() + sizeof(scriptFunctionFormat) + 20;
-        std::vector<char> scriptBuf(scriptBufSize);
-        snprintf(scriptBuf.data(), scriptBufSize, scriptFunctionFormat, scriptFunctionName.c_str(), callId);
+        // Create JXValue arguments to the call-script-batch function: an array of call IDs and an array of
+        // scripts (compiled functions or script code strings).
+        JXValue args[2];
+        JX_New(&args[0]);
+        JX_New(&args[1]);
+        JX_CreateArrayObject(&args[0]);
+        JX_CreateArrayObject(&args[1]);
+        for (size_t i = 0; i < batch->size(); i++)
+        {
+            JXValue callId;
+            JX_New(&callId);
+            JX_SetInt32(&callId, callIds[i]);
+            JX_SetIndexedProperty(&args[0], static_cast<unsigned>(i), &callId);
+            JX_Free(&callId);
+
+            JXValue script;
+            JX_New(&script);
+            SetScriptValue(&script, (*batch)[i].scriptCode);
+            JX_SetIndexedProperty(&args[1], static_cast<unsigned>(i), &script);
+            JX_Free(&script);
+        }
 
         JXValue unusedResult;
         JX_New(&unusedResult);
 
-        // Evaluate the script, which defines the named function as invoking the script call callback.
-        bool evaluated = JX_Evaluate(scriptBuf.data(), nullptr, &unusedResult);
+        // Invoke the script function that will evaluate all the scripts then callback once with all the
+        // results and errors.
+        bool evaluated = JX_CallFunction(reinterpret_cast<JXValue*>(_callScriptBatchFunction), args, 2, &unusedResult);
 
         JX_Free(&unusedResult);
+        JX_Free(&args[0]);
+        JX_Free(&args[1]);
 
         if (evaluated)
         {
-            JX_LoopOnce();
+            // The batch result callback, or the result or error callbacks, now complete the calls.
+            callIds.clear();
+            LogVerbose("Successfully evaluated a batch of %u scripts.", static_cast<unsigned int>(batch->size()));
+            RequestEventLoop();
         }
         else
         {
-            LogErrorAndThrow("Failed to evaluate script callback code.");
+            LogErrorAndThrow("Failed to evaluate script code.");
         }
     }
     catch (...)
+    {
+        std::exception_ptr ex = std::current_exception();
+        for (size_t i = 0; i < batch->size(); i++)
+        {
+            if (i < callIds.size())
+            {
+                CompleteInFlightCall(callIds[i], nullptr, ex);
+            }
+            else
+            {
+                _pendingCallCount.fetch_sub(1, std::memory_order_relaxed);
+                (*batch)[i].callback(std::string(), ex);
+            }
+        }
+    }
+}
+
+void JXCoreEngine::RegisterCallFromScriptInternal(
+    const std::string& scriptFunctionName,
+    const std::shared_ptr<const CallFromScript>& callFromScript)
+{
+    try
+    {
+        // A function registered again keeps its binding, and replaces the earlier registration's callback.
+        std::unordered_map<std::string, CallFromScriptBinding>::const_iterator bindingEntry =
+            _callFromScriptBindings.find(scriptFunctionName);
+        if (bindingEntry != _callFromScriptBindings.end())
+        {
+            *_callsFromScript.Find(bindingEntry->second.callId) = callFromScript;
+        }
+        else
+        {
+            std::shared_ptr<const CallFromScript> registration = callFromScript;
+            CallFromScriptBinding binding;
+            binding.callId = _callsFromScript.Insert(std::move(registration));
+            try
+            {
+                binding.trampolineIndex = BindCallFromScript(scriptFunctionName, binding.callId);
+            }
+            catch (...)
+            {
+                _callsFromScript.Remove(binding.callId);
+                throw;
+            }
+
+            _callFromScriptBindings.emplace(scriptFunctionName, binding);
+        }
+
+        RequestEventLoop();
+    }
+    catch (...)
     {
         LogError("Failed to register call from script.");
     }
 }
+
+size_t JXCoreEngine::BindCallFromScript(const std::string& scriptFunctionName, int32_t callId)
+{
+    // A native method is only ever reused by the name it was bound to, so a reference to an unregistered function kept
+    // by script reaches the same name's registration, as it would have through the global function, or none.
+    size_t trampolineIndex = NoTrampolineIndex;
+    std::unordered_map<std::string, size_t>::iterator retiredEntry = _retiredTrampolineIndexes.find(scriptFunctionName);
+    if (retiredEntry != _retiredTrampolineIndexes.end())
+    {
+        trampolineIndex = retiredEntry->second;
+        _retiredTrampolineIndexes.erase(retiredEntry);
+        _trampolineCallIds[trampolineIndex] = callId;
+    }
+    else if (_trampolineCallIds.size() < DirectCallFromScriptCount)
+    {
+        trampolineIndex = _trampolineCallIds.size();
+        _trampolineCallIds.push_back(callId);
+    }
+
+    if (trampolineIndex != NoTrampolineIndex)
+    {
+        // Bind the global function directly to the native method.
+        JX_SetNativeMethod(reinterpret_cast<JXValue*>(_globalObject), scriptFunctionName.c_str(),
+            GetCallFromScriptTrampoline(trampolineIndex));
+        return trampolineIndex;
+    }
+
+    // All the native methods are in use, so bind the global function to a script function that calls the shared one.
+    JXValue callIdValue;
+    JX_New(&callIdValue);
+    JX_SetInt32(&callIdValue, callId);
+
+    JXValue scriptFunction;
+    JX_New(&scriptFunction);
+    bool created = JX_CallFunction(
+        reinterpret_cast<JXValue*>(_createCallFromScriptFunction), &callIdValue, 1, &scriptFunction);
+    if (created)
+    {
+        JX_SetNamedProperty(reinterpret_cast<JXValue*>(_globalObject), scriptFunctionName.c_str(), &scriptFunction);
+    }
+
+    JX_Free(&scriptFunction);
+    JX_Free(&callIdValue);
+
+    if (!created)
+    {
+        LogErrorAndThrow("Failed to create script function for call from script.");
+    }
+
+    return NoTrampolineIndex;
+}
+
+void JXCoreEngine::UnregisterCallFromScriptInternal(const std::string& scriptFunctionName)
+{
+    std::unordered_map<std::string, CallFromScriptBinding>::iterator bindingEntry =
+        _callFromScriptBindings.find(scriptFunctionName);
+    if (bindingEntry == _callFromScriptBindings.end())
+    {
+        LogWarning("Call from script \"%s\" is not registered.", scriptFunctionName.c_str());
+        return;
+    }
+
+    // Free the registration. Its native method, if it has one, keeps the registration's dead ID, so a reference to
+    // the function kept by script fails like one to a script function does; only the same name may reuse the method.
+    _callsFromScript.Remove(bindingEntry->second.callId);
+    size_t trampolineIndex = bindingEntry->second.trampolineIndex;
+    if (trampolineIndex != NoTrampolineIndex)
+    {
+        _retiredTrampolineIndexes.emplace(scriptFunctionName, trampolineIndex);
+    }
+
+    _callFromScriptBindings.erase(bindingEntry);
+
+    // Clear the global function, so calling it fails in script rather than being ignored.
+    JXValue undefinedValue;
+    JX_New(&undefinedValue);
+    JX_SetUndefined(&undefinedValue);
+    JX_SetNamedProperty(reinterpret_cast<JXValue*>(_globalObject), scriptFunctionName.c_str(), &undefinedValue);
+    JX_Free(&undefinedValue);
+}
+
+void JXCoreEngine::InvokeCallFromScript(int32_t callId, void* argv, int argc)
+{
+    JXValue* args = reinterpret_cast<JXValue*>(argv);
+    std::shared_ptr<const CallFromScript>* registration = _callsFromScript.Find(callId);
+    if (registration == nullptr)
+    {
+        LogWarning("Invalid call callback.");
+        return;
+    }
+
+    // Hold a reference to the registration, since the callback may cause it to change before it returns.
+    std::shared_ptr<const CallFromScript> callFromScript = *registration;
+    try
+    {
+        if (callFromScript->typedCallback)
+        {
+            std::vector<NodeValue> argValues;
+            argValues.reserve(static_cast<size_t>(argc));
+            for (int i = 0; i < argc; i++)
+            {
+                argValues.push_back(GetNodeValue(args + i));
+            }
+
+            callFromScript->typedCallback(std::move(argValues));
+        }
+        else if (callFromScript->bufferCallback)
+        {
+            callFromScript->bufferCallback(GetCallFromScriptData(args, argc));
+        }
+        else
+        {
+            callFromScript->callback(FormatArgsJson(args, argc));
+        }
+    }
+    catch (...)
+    {
+        LogWarning("Script call callback function threw an exception.");
+    }
+}
@@ -2,15 +2,60 @@
 namespace OpenT2T
 {
 
+class ScriptBundle;
+
+/// Options for starting a JXCoreEngine as soon as it is constructed, so that JXCore initializes
+/// and loads the app's modules while the app is still launching, rather than when it first
+/// needs a script call.
+struct EnginePrewarmOptions
+{
+    /// Working directory to start the engine with; prewarming is disabled if this is empty.
+    std::string workingDirectory;
+
+    /// Script files to define before the engine starts, by file name, as with DefineScriptFile.
+    std::unordered_map<std::string, std::string> scriptFiles;
+
+    /// Modules to require once the engine has started, in order, such as the translators the app
+    /// calls first. A module that cannot be required is logged and skipped.
+    std::vector<std::string> modules;
+};
+
 /// Implementation of the INodeEngine interface using the JXCore hosting APIs.
 class JXCoreEngine : public INodeEngine
 {
 public:
-    JXCoreEngine();
+    /// Creates an engine whose dispatcher queue uses the specified options. A bounded queue
+    /// lets the engine shed CallScript load instead of growing without limit; control calls
+    /// (Start, Stop, DefineScriptFile, RegisterCallFromScript) are never bounded or dropped.
+    /// The options' threadOptions apply to the engine thread, which is named "JXCoreEngine"
+    /// unless they specify another name.
+    /// If a callback thread pool is specified, CallScript result callbacks and calls from script
+    /// are invoked on the pool rather than on the engine's thread, so slow callbacks do not hold
+    /// up script execution. Such callbacks may then run concurrently and out of order.
+    /// Timers, I/O and other asynchronous JavaScript work make progress whenever the engine
+    /// thread has no calls to run, without waiting for the next call to arrive.
+    /// The reentrant options control CallScript calls made on the engine thread, i.e. from a
+    /// result callback or a call from script. With ReentrantDispatchMode::Continuation such a
+    /// call runs as soon as the current script call returns, without a trip through the queue.
+    /// Script calls cannot nest, so the Inline mode is treated as Continuation.
+    /// If the prewarm options specify a working directory, the engine starts right away on its
+    /// thread, then requires the prewarm modules with background priority, so they do not hold
+    /// up calls made in the meantime. A later Start with the same working directory succeeds
+    /// without starting the engine again; calls made before then run once the engine has started.
+    JXCoreEngine(
+        const AsyncQueueOptions& dispatcherOptions = AsyncQueueOptions(),
+        const std::shared_ptr<ThreadPool>& callbackThreadPool = nullptr,
+        const ReentrantDispatchOptions& reentrantOptions = ReentrantDispatchOptions(),
+        const EnginePrewarmOptions& prewarmOptions = EnginePrewarmOptions());
     ~JXCoreEngine();
 
     void DefineScriptFile(std::string scriptFileName, std::string scriptCode) override;
 
+    /// The bundle is memory-mapped and its index read on the calling thread. A script's code is
+    /// decompressed and copied out of the mapping only when it is first required, so scripts that
+    /// are never required take up no memory beyond their index entries.
+    void DefineScriptBundle(std::string bundlePath) override;
+
     void Start(std::string workingDirectory, std::function<void(std::exception_ptr ex)> callback) override;
 
     void Stop(std::function<void(std::exception_ptr ex)> callback) override;
@@ -19,18 +64,243 @@ public:
         std::string scriptCode,
         std::function<void(std::string resultJson, std::exception_ptr ex)> callback) override;
 
+    void CallScript(
+        std::string scriptCode,
+        const CallScriptOptions& options,
+        std::function<void(std::string resultJson, std::exception_ptr ex)> callback) override;
+
+    /// Evaluates the whole batch with one call into JavaScript, which is much cheaper than a call
+    /// for each script. The batch takes one place in the queue and one turn of its tenant, and
+    /// is cancelled or dropped as a whole.
+    void CallScriptBatch(
+        std::vector<ScriptCall> calls,
+        const CallScriptOptions& options) override;
+
     void RegisterCallFromScript(
         std::string scriptFunctionName,
         std::function<void(std::string argsJson)> callback) override;
 
+    void RegisterTypedCallFromScript(
+        std::string scriptFunctionName,
+        std::function<void(std::vector<NodeValue> args)> callback) override;
+
+    void UnregisterCallFromScript(std::string scriptFunctionName) override;
+
+    /// The first this many function names registered while the engine runs are native methods of
+    /// the engine's global object, so calls from script go straight to the callback. A method stays
+    /// with its name until the engine stops, so a reference to an unregistered function kept by
+    /// script never reaches another function's callback. Other names are script functions that call
+    /// a shared native method with their registration's ID, which costs a little more.
+    static const size_t DirectCallFromScriptCount = 256;
+
+    /// The data is moved into the engine and copied once into the Buffer; the result is copied
+    /// once out of the JavaScript heap into the vector passed to the callback.
+    void CallScriptWithBuffer(
+        std::string scriptCode,
+        std::vector<uint8_t> data,
+        const CallScriptOptions& options,
+        std::function<void(std::vector<uint8_t> resultData, std::exception_ptr ex)> callback) override;
+
+    void RegisterBufferCallFromScript(
+        std::string scriptFunctionName,
+        std::function<void(std::vector<uint8_t> data)> callback) override;
+
+    /// The function is looked up and the arguments converted on the engine thread; array and
+    /// object arguments are built property by property, and Json arguments parsed by the engine.
+    void CallFunction(
+        std::string moduleName,
+        std::string functionName,
+        std::vector<NodeValue> args,
+        const CallScriptOptions& options,
+        std::function<void(NodeValue result, std::exception_ptr ex)> callback) override;
+
+    /// Script calls whose code is a single JavaScript expression are compiled into a function
+    /// the second time the code is seen, and later calls with the same code reuse the function
+    /// instead of parsing the code again; code seen only once is just evaluated, so one-off
+    /// scripts cost no more than before and do not evict others. This many distinct scripts are
+    /// kept, evicting the least recently used.
+    /// Code is only compiled when it evaluates the same as with eval; code that eval would treat
+    /// as a statement (such as "{a:1}", a block) is always evaluated.
+    static const size_t DefaultScriptCacheCapacity = 256;
+
+    /// Sets how many compiled scripts the engine keeps; 0 disables the cache.
+    void SetScriptCacheCapacity(size_t capacity);
+
+    /// Gets the size of the compiled script cache and how often script calls found their
+    /// script in it. A script that is not a single expression is evaluated each time, but is
+    /// still cached (as a hit) so that compiling it is not attempted again.
+    LruCacheStats GetScriptCacheStats() const;
+
+    /// Gets the number of script calls that have been made and have not yet finished, whether
+    /// they are still queued, running, or waiting for a promise to settle.
+    size_t GetPendingCallCount() const;
+
+    /// Gets the number of script calls that have started running and have not yet finished.
+    /// A call whose script returns a promise stays in flight until the promise settles, and up to
+    /// SlotTable::MaxSize such calls can be in flight while the engine goes on running other calls.
+    size_t GetInFlightCallCount() const;
+
+    /// Gets a snapshot of the engine's dispatcher queue activity: depth, enqueue rate, how long
+    /// calls wait before running and how long they run, and exceptions caught by the queue.
+    AsyncQueueStats GetQueueStats() const;
+
+    /// Restarts the statistics returned by GetQueueStats.
+    void ResetQueueStats();
+
+    /// Sets how many script calls a tenant (see CallScriptOptions::tenant) may run each time
+    /// its turn comes round, relative to other tenants with calls waiting. The default is 1.
+    void SetTenantWeight(size_t tenant, unsigned int weight);
+
+    /// Gets the queue depth, call counts and wait times of each tenant with calls waiting or a
+    /// weight set, and of the default tenant; see AsyncQueue::GetTenantStats.
+    std::vector<AsyncQueueTenantStats> GetTenantStats() const;
+
 private:
-    void CallScriptInternal(
+    /// Dispatcher priority lanes, highest priority first. Control calls (Start, Stop,
+    /// DefineScriptFile, RegisterCallFromScript) get their own lane ahead of all script calls.
+    enum DispatchLane : size_t
+    {
+        ControlLane,
+        InteractiveLane,
+        NormalLane,
+        BackgroundLane,
+        DispatchLaneCount,
+    };
+
+    static AsyncQueueOptions GetDispatcherOptions(const AsyncQueueOptions& options);
+    static ReentrantDispatchOptions GetReentrantDispatchOptions(const ReentrantDispatchOptions& options);
+
+    /// Runs the JXCore event loop once; called by the dispatcher whenever its queue runs out of
+    /// calls. Returns how long the dispatcher may wait before running the loop again.
+    std::chrono::steady_clock::duration RunEventLoop();
+
+    /// Has the dispatcher run the event loop before the next call, after a call that may have
+    /// scheduled timers, I/O or promise callbacks, so that they are not delayed behind the queue.
+    void RequestEventLoop();
+
+    /// Starts the engine and dispatches requiring the prewarm modules; called by the constructor.
+    void Prewarm(const EnginePrewarmOptions& prewarmOptions);
+
+    /// Requires modules (and makes a trivial script call, so the call path is compiled too).
+    void PrewarmModulesInternal(const std::vector<std::string>& modules);
+
+    static DispatchLane GetCallScriptLane(const CallScriptOptions& options);
+
+    /// Callback of a script call that has started running. It gets the JXValue* result (or null on
+    /// failure), and converts it while it is valid.
+    typedef UniqueFunction<void(void* result, std::exception_ptr ex)> ResultCallbackType;
+
+    /// A function registered to be called from script; at most one of the callbacks is set.
+    struct CallFromScript
+    {
+        std::function<void(std::string argsJson)> callback;
+        std::function<void(std::vector<NodeValue> args)> typedCallback;
+        std::function<void(std::vector<uint8_t> data)> bufferCallback;
+    };
+
+    /// Where a registered function name is bound: the registration's ID in _callsFromScript, and
+    /// the index of the native method it is bound to, or NoTrampolineIndex if it is not.
+    struct CallFromScriptBinding
+    {
+        int32_t callId;
+        size_t trampolineIndex;
+    };
+
+    static const size_t NoTrampolineIndex = static_cast<size_t>(-1);
+
+    template <size_t Index>
+    friend struct CallFromScriptTrampoline;
+
+    /// Callbacks from JavaScript, taking JXValue* arguments. They find the engine via the thread
+    /// they are invoked on.
+    static void JXResultCallback(void* argv, int argc);
+    static void JXErrorCallback(void* argv, int argc);
+    static void JXBatchResultCallback(void* argv, int argc);
+    static void JXDefineBundledScriptCallback(void* argv, int argc);
+    static void JXCallFromScriptCallback(void* argv, int argc);
+
+    /// Wraps a callback so that it is invoked on the callback thread pool, if there is one.
+    template <typename... Args>
+    std::function<void(Args...)> WrapForCallbackThreadPool(std::function<void(Args...)> callback);
+
+    /// Creates the dispatcher work item for a script call. If the item is cancelled or dropped
+    /// from a full queue, the callback is invoked with an exception instead.
+    WorkItemDispatcher::WorkItem CreateCallScriptWorkItem(
         std::string scriptCode,
-        std::function<void(std::string resultJson, std::exception_ptr ex)> callback);
+        std::function<void(std::string resultJson, std::exception_ptr ex)> callback,
+        const CancellationToken& cancellationToken);
+
+    /// Gets the cached compiled function (a JXValue*) for script code, compiling and caching
+    /// it first if necessary. Returns nullptr if the code cannot be compiled as an expression.
+    void* GetCompiledScript(const std::string& scriptCode);
+
+    /// Sets a JXValue to the compiled function for script code, or if it cannot be compiled to the code itself.
+    void SetScriptValue(void* value, const std::string& scriptCode);
+
+    static void FreeCompiledScript(void*& compiledScript);
+
+    /// Gets the error for a call that was cancelled or dropped from a full queue.
+    static std::exception_ptr GetDroppedCallException(const CancellationToken& cancellationToken);
+
+    /// Tracks a call that is starting to run as in flight, and returns the ID that is passed
+    /// through JavaScript to complete it. The result callback is left unchanged if this throws.
+    int32_t CreateInFlightCall(ResultCallbackType&& resultCallback);
+
+    /// Stops tracking an in-flight call and invokes its result callback. Unknown IDs are ignored.
+    void CompleteInFlightCall(int32_t callId, void* result, std::exception_ptr ex);
+
+    /// Fails calls still waiting for promises to settle, when the engine is stopping.
+    void FailInFlightCalls();
+
+    /// The internal call methods below move the callback out of the work item that invokes them.
+
+    void CallScriptInternal(
+        const std::string& scriptCode,
+        std::function<void(std::string resultJson, std::exception_ptr ex)>& callback);
+
+    void CallScriptWithBufferInternal(
+        const std::string& scriptCode,
+        const std::vector<uint8_t>& data,
+        std::function<void(std::vector<uint8_t> resultData, std::exception_ptr ex)>& callback);
+
+    void CallFunctionInternal(
+        const std::string& moduleName,
+        const std::string& functionName,
+        const std::vector<NodeValue>& args,
+        std::function<void(NodeValue result, std::exception_ptr ex)>& callback);
+
+    /// Evaluates a script call, passing it the data as a Buffer if there is any data.
+    void EvaluateScriptCall(
+        const std::string& scriptCode,
+        const std::vector<uint8_t>* data,
+        ResultCallbackType resultCallback);
+
+    void CallScriptBatchInternal(const std::shared_ptr<std::vector<ScriptCall>>& batch);
+
+    /// Registers a function to be called from script now, or when the engine starts.
+    void DispatchRegisterCallFromScript(std::string scriptFunctionName, CallFromScript callFromScript);
 
     void RegisterCallFromScriptInternal(
-        std::string scriptFunctionName,
-        std::function<void(std::string argsJson)> callback);
+        const std::string& scriptFunctionName,
+        const std::shared_ptr<const CallFromScript>& callFromScript);
+
+    /// Binds a global function of the name to a registration, using the name's earlier native
+    /// method or a new one if there is one. Returns the index of the native method, or
+    /// NoTrampolineIndex.
+    size_t BindCallFromScript(const std::string& scriptFunctionName, int32_t callId);
+
+    void UnregisterCallFromScriptInternal(const std::string& scriptFunctionName);
+
+    /// Invokes the callback of a registered function, by its registration's ID, with the JXValue*
+    /// arguments it was called with from script. Called by the native method the function is
+    /// bound to, or by the shared one.
+    void InvokeCallFromScript(int32_t callId, void* argv, int argc);
+
+    /// Adds the names of a bundle's scripts to those that are defined when first required.
+    void AddBundledScriptsInternal(const ScriptBundle& scriptBundle);
+
+    /// Defines a bundled script that is being required for the first time.
+    void DefineBundledScriptInternal(const std::string& scriptFileName);
 
     /// Tracks whether JXCore's one-time initialization has been invoked.
     static std::once_flag _initOnce;
@@ -40,18 +310,79 @@ private:
 
     /// Dispatches calls to a thread dedicated to the JXCore engine instance.
     WorkItemDispatcher _dispatcher;
+    std::shared_ptr<ThreadPool> _callbackThreadPool;
 
     /// Tracks script files that are defined before the engine is started.
     std::unordered_map<std::string, std::string> _initialScriptMap;
 
+    /// Script bundles that have been defined, in order. Only used on the engine thread.
+    std::vector<std::shared_ptr<const ScriptBundle>> _scriptBundles;
+
     /// Tracks call-from-script functions that are registered before the engine is started.
-    std::unordered_map<std::string, std::function<void(std::string)>> _initialCallFromScriptMap;
+    std::unordered_map<std::string, std::shared_ptr<const CallFromScript>> _initialCallFromScriptMap;
 
     /// Tracks whether the engine has been started.
     bool _started;
 
+    /// Tracks whether the engine was started by prewarming, and no Start call has been made since.
+    bool _startedByPrewarm;
+
+    /// Script calls queued, running or waiting for a promise; see GetPendingCallCount.
+    std::atomic<size_t> _pendingCallCount;
+
+    /// Result callbacks of script calls that have started running and not finished, by call ID,
+    /// and their count (which, unlike the table, can be read from any thread). The table is only
+    /// used on the engine thread.
+    SlotTable<ResultCallbackType> _inFlightCalls;
+    std::atomic<size_t> _inFlightCallCount;
+
+    /// Functions registered to be called from script since the engine started, by ID; their
+    /// bindings by script function name; the registration IDs by the index of the native method
+    /// they are bound to (an unregistered one keeps its dead ID), and the native methods of
+    /// unregistered functions by name, for the name to reuse. Only used on the engine thread.
+    SlotTable<std::shared_ptr<const CallFromScript>> _callsFromScript;
+    std::unordered_map<std::string, CallFromScriptBinding> _callFromScriptBindings;
+    std::vector<int32_t> _trampolineCallIds;
+    std::unordered_map<std::string, size_t> _retiredTrampolineIndexes;
+
+    /// Pointer to a JXValue representing the engine's global object, which registered functions
+    /// are bound to.
+    void* _globalObject;
+
     /// Pointer to a JXValue representing a JavaScript function used to evaluate script code in the engine.
     void* _callScriptFunction;
+
+    /// Pointer to a JXValue representing a JavaScript function used to call script with a Buffer.
+    void* _callScriptWithBufferFunction;
+
+    /// Pointer to a JXValue representing a JavaScript function used to call a module's function.
+    void* _callFunctionFunction;
+
+    /// Pointer to a JXValue representing a JavaScript function used to evaluate a batch of script code.
+    void* _callScriptBatchFunction;
+
+    /// Pointer to a JXValue representing a JavaScript function that compiles script code.
+    void* _compileScriptFunction;
+
+    /// Pointer to a JXValue representing a JavaScript function that adds the names of bundled scripts.
+    void* _addBundledScriptsFunction;
+
+    /// Pointer to a JXValue representing a JavaScript function that creates a function to be called from
+    /// script, for registrations beyond the native methods.
+    void* _createCallFromScriptFunction;
+
+    /// Compiled functions for recent script calls, by script code. Only used on the engine thread.
+    LruCache<std::string, void*> _scriptCache;
+
+    /// Hashes of script code seen once and not yet cached, each in the slot its value selects, so
+    /// that code is only compiled when it is seen again. A collision only makes a script wait
+    /// longer, or get compiled sooner. Only used on the engine thread.
+    static const size_t SeenScriptHashCount = 1024;
+    std::vector<size_t> _seenScriptHashes;
+
+    /// Next interval at which to poll the event loop while it has pending work. Only used on the
+    /// engine thread.
+    std::chrono::steady_clock::duration _eventLoopPollInterval;
 };
 
 }
\ No newline at end of file
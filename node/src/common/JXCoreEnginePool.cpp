@@ -0,0 +1,335 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "Log.h"
+#include "CancellationToken.h"
+#include "NodeValue.h"
+#include "INodeEngine.h"
+#include "ThreadOptions.h"
+#include "MpscQueue.h"
+#include "RingQueue.h"
+#include "FairQueue.h"
+#include "AsyncQueue.h"
+#include "UniqueFunction.h"
+#include "WorkItemDispatcher.h"
+#include "ThreadPool.h"
+#include "LruCache.h"
+#include "SlotTable.h"
+#include "JXCoreEngine.h"
+#include "JXCoreEnginePool.h"
+
+using namespace OpenT2T;
+
+const size_t JXCoreEnginePool::MaxEngineCount;
+
+JXCoreEnginePool::JXCoreEnginePool(
+    size_t engineCount,
+    const AsyncQueueOptions& dispatcherOptions,
+    const std::shared_ptr<ThreadPool>& callbackThreadPool,
+    const ReentrantDispatchOptions& reentrantOptions,
+    const EnginePrewarmOptions& prewarmOptions) :
+    _nextEngineIndex(0)
+{
+    if (engineCount == 0 || engineCount > MaxEngineCount)
+    {
+        throw std::invalid_argument("The engine count must be between 1 and 64.");
+    }
+
+    _engines.reserve(engineCount);
+    for (size_t i = 0; i < engineCount; i++)
+    {
+        AsyncQueueOptions engineOptions = dispatcherOptions;
+        if (engineOptions.threadOptions.name.empty())
+        {
+            char threadName[20];
+            snprintf(threadName, sizeof(threadName), "JXCoreEngine%u", static_cast<unsigned int>(i));
+            engineOptions.threadOptions.name = threadName;
+        }
+
+        _engines.emplace_back(new JXCoreEngine(
+            engineOptions,
+            callbackThreadPool,
+            reentrantOptions,
+            (i == 0 ? prewarmOptions : EnginePrewarmOptions())));
+    }
+}
+
+JXCoreEnginePool::~JXCoreEnginePool()
+{
+    // Shut down the first engine's thread last, as in Stop.
+    while (!_engines.empty())
+    {
+        _engines.pop_back();
+    }
+}
+
+void JXCoreEnginePool::DefineScriptFile(std::string scriptFileName, std::string scriptCode)
+{
+    LogTrace("JXCoreEnginePool::DefineScriptFile(\"%s\", \"...\")", scriptFileName.c_str());
+
+    for (std::unique_ptr<JXCoreEngine>& engine : _engines)
+    {
+        engine->DefineScriptFile(scriptFileName, scriptCode);
+    }
+}
+
+void JXCoreEnginePool::DefineScriptBundle(std::string bundlePath)
+{
+    LogTrace("JXCoreEnginePool::DefineScriptBundle(\"%s\")", bundlePath.c_str());
+
+    for (std::unique_ptr<JXCoreEngine>& engine : _engines)
+    {
+        engine->DefineScriptBundle(bundlePath);
+    }
+}
+
+void JXCoreEnginePool::Start(std::string workingDirectory, std::function<void(std::exception_ptr ex)> callback)
+{
+    LogTrace("JXCoreEnginePool::Start(\"%s\")", workingDirectory.c_str());
+
+    // JXCore's first engine instance must be created before the others and destroyed after
+    // them, so the first engine is started on its own and the rest once it is running.
+    _engines[0]->Start(workingDirectory, [this, workingDirectory, callback](std::exception_ptr ex)
+    {
+        if (ex != nullptr || _engines.size() == 1)
+        {
+            callback(ex);
+            return;
+        }
+
+        std::function<void(std::exception_ptr ex)> joinedCallback =
+            CreateJoinedCallback(_engines.size() - 1, callback);
+        for (size_t i = 1; i < _engines.size(); i++)
+        {
+            try
+            {
+                _engines[i]->Start(workingDirectory, joinedCallback);
+            }
+            catch (...)
+            {
+                joinedCallback(std::current_exception());
+            }
+        }
+    });
+}
+
+void JXCoreEnginePool::Stop(std::function<void(std::exception_ptr ex)> callback)
+{
+    LogTrace("JXCoreEnginePool::Stop()");
+
+    if (_engines.size() == 1)
+    {
+        _engines[0]->Stop(callback);
+        return;
+    }
+
+    // Stop the first engine after the others; see Start.
+    std::function<void(std::exception_ptr ex)> stopFirstEngine = [this, callback](std::exception_ptr ex)
+    {
+        _engines[0]->Stop([callback, ex](std::exception_ptr firstEngineEx)
+        {
+            callback(ex != nullptr ? ex : firstEngineEx);
+        });
+    };
+
+    std::function<void(std::exception_ptr ex)> joinedCallback =
+        CreateJoinedCallback(_engines.size() - 1, stopFirstEngine);
+    for (size_t i = 1; i < _engines.size(); i++)
+    {
+        _engines[i]->Stop(joinedCallback);
+    }
+}
+
+void JXCoreEnginePool::CallScript(
+    std::string scriptCode,
+    std::function<void(std::string resultJson, std::exception_ptr ex)> callback)
+{
+    this->CallScript(std::move(scriptCode), CallScriptOptions(), std::move(callback));
+}
+
+void JXCoreEnginePool::CallScript(
+    std::string scriptCode,
+    const CallScriptOptions& options,
+    std::function<void(std::string resultJson, std::exception_ptr ex)> callback)
+{
+    SelectEngine(options).CallScript(std::move(scriptCode), options, std::move(callback));
+}
+
+void JXCoreEnginePool::CallScriptBatch(
+    std::vector<ScriptCall> calls,
+    const CallScriptOptions& options)
+{
+    SelectEngine(options).CallScriptBatch(std::move(calls), options);
+}
+
+void JXCoreEnginePool::RegisterCallFromScript(
+    std::string scriptFunctionName,
+    std::function<void(std::string argsJson)> callback)
+{
+    LogTrace("JXCoreEnginePool::RegisterCallFromScript(\"%s\")", scriptFunctionName.c_str());
+
+    for (std::unique_ptr<JXCoreEngine>& engine : _engines)
+    {
+        engine->RegisterCallFromScript(scriptFunctionName, callback);
+    }
+}
+
+void JXCoreEnginePool::RegisterTypedCallFromScript(
+    std::string scriptFunctionName,
+    std::function<void(std::vector<NodeValue> args)> callback)
+{
+    LogTrace("JXCoreEnginePool::RegisterTypedCallFromScript(\"%s\")", scriptFunctionName.c_str());
+
+    for (std::unique_ptr<JXCoreEngine>& engine : _engines)
+    {
+        engine->RegisterTypedCallFromScript(scriptFunctionName, callback);
+    }
+}
+
+void JXCoreEnginePool::UnregisterCallFromScript(std::string scriptFunctionName)
+{
+    LogTrace("JXCoreEnginePool::UnregisterCallFromScript(\"%s\")", scriptFunctionName.c_str());
+
+    for (std::unique_ptr<JXCoreEngine>& engine : _engines)
+    {
+        engine->UnregisterCallFromScript(scriptFunctionName);
+    }
+}
+
+void JXCoreEnginePool::CallScriptWithBuffer(
+    std::string scriptCode,
+    std::vector<uint8_t> data,
+    const CallScriptOptions& options,
+    std::function<void(std::vector<uint8_t> resultData, std::exception_ptr ex)> callback)
+{
+    SelectEngine(options).CallScriptWithBuffer(std::move(scriptCode), std::move(data), options, std::move(callback));
+}
+
+void JXCoreEnginePool::RegisterBufferCallFromScript(
+    std::string scriptFunctionName,
+    std::function<void(std::vector<uint8_t> data)> callback)
+{
+    LogTrace("JXCoreEnginePool::RegisterBufferCallFromScript(\"%s\")", scriptFunctionName.c_str());
+
+    for (std::unique_ptr<JXCoreEngine>& engine : _engines)
+    {
+        engine->RegisterBufferCallFromScript(scriptFunctionName, callback);
+    }
+}
+
+void JXCoreEnginePool::CallFunction(
+    std::string moduleName,
+    std::string functionName,
+    std::vector<NodeValue> args,
+    const CallScriptOptions& options,
+    std::function<void(NodeValue result, std::exception_ptr ex)> callback)
+{
+    SelectEngine(options).CallFunction(
+        std::move(moduleName), std::move(functionName), std::move(args), options, std::move(callback));
+}
+
+size_t JXCoreEnginePool::GetEngineCount() const
+{
+    return _engines.size();
+}
+
+size_t JXCoreEnginePool::GetInFlightCallCount() const
+{
+    size_t inFlightCallCount = 0;
+    for (const std::unique_ptr<JXCoreEngine>& engine : _engines)
+    {
+        inFlightCallCount += engine->GetInFlightCallCount();
+    }
+    return inFlightCallCount;
+}
+
+JXCoreEngine& JXCoreEnginePool::GetEngine(size_t index)
+{
+    return *_engines.at(index);
+}
+
+size_t JXCoreEnginePool::GetAffinityEngineIndex(size_t affinityKey) const
+{
+    // Keys are often small sequential IDs, or hashes; either way the remainder spreads them.
+    return affinityKey % _engines.size();
+}
+
+JXCoreEngine& JXCoreEnginePool::SelectEngine(const CallScriptOptions& options)
+{
+    if (options.affinityKey != 0)
+    {
+        return *_engines[GetAffinityEngineIndex(options.affinityKey)];
+    }
+
+    size_t engineCount = _engines.size();
+    size_t firstIndex = _nextEngineIndex.fetch_add(1, std::memory_order_relaxed) % engineCount;
+    size_t selectedIndex = firstIndex;
+    size_t selectedCallCount = _engines[firstIndex]->GetPendingCallCount();
+    for (size_t i = 1; i < engineCount && selectedCallCount != 0; i++)
+    {
+        size_t index = (firstIndex + i) % engineCount;
+        size_t callCount = _engines[index]->GetPendingCallCount();
+        if (callCount < selectedCallCount)
+        {
+            selectedIndex = index;
+            selectedCallCount = callCount;
+        }
+    }
+
+    return *_engines[selectedIndex];
+}
+
+std::function<void(std::exception_ptr ex)> JXCoreEnginePool::CreateJoinedCallback(
+    size_t count,
+    std::function<void(std::exception_ptr ex)> callback)
+{
+    struct JoinState
+    {
+        std::mutex mutex;
+        size_t remainingCount;
+        std::exception_ptr firstException;
+        std::function<void(std::exception_ptr ex)> callback;
+    };
+
+    std::shared_ptr<JoinState> state = std::make_shared<JoinState>();
+    state->remainingCount = count;
+    state->callback = std::move(callback);
+
+    return [state](std::exception_ptr ex)
+    {
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (ex != nullptr && state->firstException == nullptr)
+            {
+                state->firstException = ex;
+            }
+
+            if (--state->remainingCount != 0)
+            {
+                return;
+            }
+        }
+
+        state->callback(state->firstException);
+    };
+}
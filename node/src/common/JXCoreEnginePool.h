@@ -0,0 +1,130 @@
+//
+// Copyright (c) 2015, Microsoft Corporation
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR
+// IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+namespace OpenT2T
+{
+
+/// Implementation of the INodeEngine interface that spreads script calls over several JXCore
+/// engine instances, each running on its own thread, so that script execution is not limited
+/// to one core. Script files and calls from script are defined in every engine, and Start and
+/// Stop apply to all of them. The engines do not share any JavaScript state, so a call with an
+/// affinity key (see CallScriptOptions::affinityKey) always runs on the same engine; other
+/// calls go to the engine with the fewest calls waiting.
+class JXCoreEnginePool : public INodeEngine
+{
+public:
+    /// JXCore supports at most this many engine instances in a process.
+    static const size_t MaxEngineCount = 64;
+
+    /// Creates a pool of engineCount engines (1 to MaxEngineCount), each constructed with the
+    /// specified options; see JXCoreEngine. The engine threads are named "JXCoreEngine0",
+    /// "JXCoreEngine1" and so on unless the options specify a name.
+    /// Calls from script may be invoked on any engine's thread, so the same callback can run
+    /// concurrently; the callback thread pool, if any, is shared by all the engines.
+    /// Only the first engine is prewarmed, since the others cannot start before it is running;
+    /// they start with the pool's Start as usual.
+    JXCoreEnginePool(
+        size_t engineCount,
+        const AsyncQueueOptions& dispatcherOptions = AsyncQueueOptions(),
+        const std::shared_ptr<ThreadPool>& callbackThreadPool = nullptr,
+        const ReentrantDispatchOptions& reentrantOptions = ReentrantDispatchOptions(),
+        const EnginePrewarmOptions& prewarmOptions = EnginePrewarmOptions());
+    ~JXCoreEnginePool();
+
+    void DefineScriptFile(std::string scriptFileName, std::string scriptCode) override;
+
+    /// Each engine maps the bundle file; the mappings share the same pages of the file.
+    void DefineScriptBundle(std::string bundlePath) override;
+
+    /// Starts all the engines. The callback is invoked once they have all started, with the
+    /// first failure if any did not.
+    void Start(std::string workingDirectory, std::function<void(std::exception_ptr ex)> callback) override;
+
+    /// Stops all the engines. The callback is invoked once they have all stopped, with the
+    /// first failure if any did not.
+    void Stop(std::function<void(std::exception_ptr ex)> callback) override;
+
+    void CallScript(
+        std::string scriptCode,
+        std::function<void(std::string resultJson, std::exception_ptr ex)> callback) override;
+
+    void CallScript(
+        std::string scriptCode,
+        const CallScriptOptions& options,
+        std::function<void(std::string resultJson, std::exception_ptr ex)> callback) override;
+
+    /// Runs the whole batch on one engine, chosen as for a single call with the same options.
+    void CallScriptBatch(
+        std::vector<ScriptCall> calls,
+        const CallScriptOptions& options) override;
+
+    void RegisterCallFromScript(
+        std::string scriptFunctionName,
+        std::function<void(std::string argsJson)> callback) override;
+
+    void RegisterTypedCallFromScript(
+        std::string scriptFunctionName,
+        std::function<void(std::vector<NodeValue> args)> callback) override;
+
+    void UnregisterCallFromScript(std::string scriptFunctionName) override;
+
+    void CallScriptWithBuffer(
+        std::string scriptCode,
+        std::vector<uint8_t> data,
+        const CallScriptOptions& options,
+        std::function<void(std::vector<uint8_t> resultData, std::exception_ptr ex)> callback) override;
+
+    void RegisterBufferCallFromScript(
+        std::string scriptFunctionName,
+        std::function<void(std::vector<uint8_t> data)> callback) override;
+
+    void CallFunction(
+        std::string moduleName,
+        std::string functionName,
+        std::vector<NodeValue> args,
+        const CallScriptOptions& options,
+        std::function<void(NodeValue result, std::exception_ptr ex)> callback) override;
+
+    size_t GetEngineCount() const;
+
+    /// Gets the total number of script calls in flight on all the engines.
+    size_t GetInFlightCallCount() const;
+
+    /// Gets one of the engines, for example to read its queue statistics.
+    JXCoreEngine& GetEngine(size_t index);
+
+    /// Gets the index of the engine that runs calls with the specified (nonzero) affinity key.
+    size_t GetAffinityEngineIndex(size_t affinityKey) const;
+
+private:
+    /// Chooses the engine for a script call: by affinity key if the call has one, otherwise
+    /// the engine with the shortest queue, looking at the engines in round-robin order so that
+    /// idle engines share the load.
+    JXCoreEngine& SelectEngine(const CallScriptOptions& options);
+
+    /// Creates a callback that can be passed to several engines' Start or Stop, and invokes the
+    /// specified callback once it has been invoked count times.
+    static std::function<void(std::exception_ptr ex)> CreateJoinedCallback(
+        size_t count,
+        std::function<void(std::exception_ptr ex)> callback);
+
+    std::vector<std::unique_ptr<JXCoreEngine>> _engines;
+
+    /// Where the next search for the least-loaded engine begins.
+    std::atomic<size_t> _nextEngineIndex;
+};
+
+}
@@ -0,0 +1,202 @@
+//
+// Copyright (c) 2015, Microsoft Corporation
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR
+// IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+namespace OpenT2T
+{
+
+// Snapshot of an LruCache's size and lookup counts.
+struct LruCacheStats
+{
+    LruCacheStats() : capacity(0), size(0), hitCount(0), missCount(0), evictionCount(0) { }
+
+    // Fraction of lookups that found their key, or 0 if there have been none.
+    double GetHitRate() const
+    {
+        uint64_t lookupCount = hitCount + missCount;
+        return (lookupCount != 0 ? static_cast<double>(hitCount) / lookupCount : 0.0);
+    }
+
+    size_t capacity;
+    size_t size;
+    uint64_t hitCount;
+    uint64_t missCount;
+
+    // Entries removed to make room for new ones.
+    uint64_t evictionCount;
+};
+
+// Implements a map with a maximum size that, when full, makes room for a new entry by removing
+// the least recently used one. Removed values are passed to a dispose function, for values
+// that own resources. Not thread-safe, except that GetStats may be called from any thread.
+template <class Key, class Value>
+class LruCache
+{
+public:
+    typedef std::function<void(Value& value)> DisposeFunctionType;
+
+    LruCache(size_t capacity, DisposeFunctionType disposeFunction = nullptr) :
+        _disposeFunction(std::move(disposeFunction)),
+        _capacity(capacity),
+        _size(0),
+        _hitCount(0),
+        _missCount(0),
+        _evictionCount(0)
+    {
+    }
+
+    ~LruCache()
+    {
+        Clear();
+    }
+
+    size_t GetCapacity() const
+    {
+        return _capacity.load(std::memory_order_relaxed);
+    }
+
+    // Changes the maximum number of entries, removing the least recently used ones if there
+    // are now too many. A capacity of 0 disables the cache.
+    void SetCapacity(size_t capacity)
+    {
+        _capacity.store(capacity, std::memory_order_relaxed);
+        while (_entries.size() > capacity)
+        {
+            Evict();
+        }
+    }
+
+    // Finds the value for a key and marks it as the most recently used, or returns nullptr
+    // if the key is not in the cache. The pointer is valid until the cache is next modified.
+    Value* Find(const Key& key)
+    {
+        typename IndexType::iterator indexEntry = _index.find(key);
+        if (indexEntry == _index.end())
+        {
+            _missCount.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        _hitCount.fetch_add(1, std::memory_order_relaxed);
+        _entries.splice(_entries.begin(), _entries, indexEntry->second);
+        return &indexEntry->second->second;
+    }
+
+    // Adds an entry as the most recently used, removing the least recently used entry first
+    // if the cache is full. Replaces (and disposes) any value the key already had. Does
+    // nothing but dispose the value if the capacity is 0.
+    template <typename ValueType>
+    void Insert(const Key& key, ValueType&& value)
+    {
+        typename IndexType::iterator indexEntry = _index.find(key);
+        if (indexEntry != _index.end())
+        {
+            Remove(indexEntry->second);
+        }
+
+        if (GetCapacity() == 0)
+        {
+            Value unusedValue(std::forward<ValueType>(value));
+            Dispose(unusedValue);
+            return;
+        }
+
+        while (_entries.size() >= GetCapacity())
+        {
+            Evict();
+        }
+
+        _entries.emplace_front(key, std::forward<ValueType>(value));
+        _index.emplace(key, _entries.begin());
+        _size.store(_entries.size(), std::memory_order_relaxed);
+    }
+
+    // Removes (and disposes) all entries. The statistics are kept.
+    void Clear()
+    {
+        for (EntryType& entry : _entries)
+        {
+            Dispose(entry.second);
+        }
+
+        _entries.clear();
+        _index.clear();
+        _size.store(0, std::memory_order_relaxed);
+    }
+
+    // Removes all entries without disposing them, for when their resources can no longer be
+    // released (such as when the thread that owns them has gone). The statistics are kept.
+    void Abandon()
+    {
+        _entries.clear();
+        _index.clear();
+        _size.store(0, std::memory_order_relaxed);
+    }
+
+    LruCacheStats GetStats() const
+    {
+        LruCacheStats stats;
+        stats.capacity = _capacity.load(std::memory_order_relaxed);
+        stats.size = _size.load(std::memory_order_relaxed);
+        stats.hitCount = _hitCount.load(std::memory_order_relaxed);
+        stats.missCount = _missCount.load(std::memory_order_relaxed);
+        stats.evictionCount = _evictionCount.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    LruCache(const LruCache&) = delete;
+    LruCache& operator=(const LruCache&) = delete;
+
+    // Entries are kept in order of use, most recent first; the index points into the list.
+    typedef std::pair<Key, Value> EntryType;
+    typedef std::list<EntryType> EntryListType;
+    typedef std::unordered_map<Key, typename EntryListType::iterator> IndexType;
+
+    void Evict()
+    {
+        Remove(std::prev(_entries.end()));
+        _evictionCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Remove(typename EntryListType::iterator entry)
+    {
+        Dispose(entry->second);
+        _index.erase(entry->first);
+        _entries.erase(entry);
+        _size.store(_entries.size(), std::memory_order_relaxed);
+    }
+
+    void Dispose(Value& value)
+    {
+        if (_disposeFunction)
+        {
+            _disposeFunction(value);
+        }
+    }
+
+    EntryListType _entries;
+    IndexType _index;
+    DisposeFunctionType _disposeFunction;
+
+    // Atomic so that GetStats can be called from other threads.
+    std::atomic<size_t> _capacity;
+    std::atomic<size_t> _size;
+    std::atomic<uint64_t> _hitCount;
+    std::atomic<uint64_t> _missCount;
+    std::atomic<uint64_t> _evictionCount;
+};
+
+}
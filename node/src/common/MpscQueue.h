@@ -0,0 +1,193 @@
+//
+// Copyright (c) 2015, Microsoft Corporation
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR
+// IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+namespace OpenT2T
+{
+
+// Implements an unbounded multi-producer/single-consumer FIFO queue without locks
+// (Dmitry Vyukov's linked-node algorithm). Push may be called concurrently from any
+// number of threads and costs a single atomic exchange. TryPop, IsEmpty and Clear
+// must only be called by one consumer at a time; callers that need more than one
+// consumer thread must serialize them externally (e.g. with a mutex).
+template <class Item>
+class MpscQueue
+{
+    struct Node;
+
+public:
+    MpscQueue()
+    {
+        Node* stub = new Node();
+        _head.store(stub);
+        _tail = stub;
+    }
+
+    ~MpscQueue()
+    {
+        Clear();
+        delete _tail;
+    }
+
+    // Pushes an item onto the queue. Safe to call from any thread.
+    template <typename ItemType>
+    void Push(ItemType&& item)
+    {
+        Node* node = new Node();
+        node->Construct(std::forward<ItemType>(item));
+
+        Node* prev = _head.exchange(node);
+
+        // Between the exchange above and this store the queue is briefly "unlinked":
+        // IsEmpty() reports false but TryPop() cannot reach the new node yet.
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // A sequence of nodes linked privately by one producer, to be published with PushBatch.
+    class Batch
+    {
+    public:
+        Batch() : _first(nullptr), _last(nullptr) { }
+
+        ~Batch()
+        {
+            while (_first != nullptr)
+            {
+                Node* next = _first->next.load(std::memory_order_relaxed);
+                delete _first;
+                _first = next;
+            }
+        }
+
+        template <typename ItemType>
+        void Push(ItemType&& item)
+        {
+            Node* node = new Node();
+            node->Construct(std::forward<ItemType>(item));
+
+            if (_last == nullptr)
+            {
+                _first = node;
+            }
+            else
+            {
+                _last->next.store(node, std::memory_order_relaxed);
+            }
+            _last = node;
+        }
+
+    private:
+        friend class MpscQueue;
+
+        Batch(const Batch&) = delete;
+        Batch& operator=(const Batch&) = delete;
+
+        Node* _first;
+        Node* _last;
+    };
+
+    // Pushes all items of the batch, in order, with a single atomic exchange, leaving the
+    // batch empty. Items from concurrent pushes are never interleaved with the batch's.
+    void PushBatch(Batch& batch)
+    {
+        if (batch._first == nullptr)
+        {
+            return;
+        }
+
+        Node* prev = _head.exchange(batch._last);
+        prev->next.store(batch._first, std::memory_order_release);
+        batch._first = nullptr;
+        batch._last = nullptr;
+    }
+
+    // Pops the oldest item off the queue, if one is available. Consumer only.
+    // May return false while IsEmpty() is also false if a concurrent Push has not
+    // finished linking its node; the caller should retry shortly in that case.
+    bool TryPop(Item& item)
+    {
+        Node* tail = _tail;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (next == nullptr)
+        {
+            return false;
+        }
+
+        // The popped node becomes the new stub, so its item is moved out and destroyed in place.
+        item = std::move(next->Get());
+        next->Destroy();
+        _tail = next;
+        delete tail;
+        return true;
+    }
+
+    // Returns true if every pushed item has been popped. Consumer only.
+    bool IsEmpty() const
+    {
+        return _head.load() == _tail;
+    }
+
+    // Discards all items that are currently reachable by the consumer. Consumer only.
+    void Clear()
+    {
+        Node* next;
+        while ((next = _tail->next.load(std::memory_order_acquire)) != nullptr)
+        {
+            next->Destroy();
+            delete _tail;
+            _tail = next;
+        }
+    }
+
+private:
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    struct Node
+    {
+        Node() : next(nullptr), hasItem(false) { }
+        ~Node() { Destroy(); }
+
+        template <typename ItemType>
+        void Construct(ItemType&& item)
+        {
+            new (&storage) Item(std::forward<ItemType>(item));
+            hasItem = true;
+        }
+
+        Item& Get() { return *reinterpret_cast<Item*>(&storage); }
+
+        void Destroy()
+        {
+            if (hasItem)
+            {
+                Get().~Item();
+                hasItem = false;
+            }
+        }
+
+        std::atomic<Node*> next;
+        typename std::aligned_storage<sizeof(Item), alignof(Item)>::type storage;
+        bool hasItem;
+    };
+
+    // Most recently pushed node; shared by all producers.
+    std::atomic<Node*> _head;
+
+    // Stub node preceding the oldest item; owned by the consumer.
+    Node* _tail;
+};
+
+}
@@ -0,0 +1,453 @@
+//
+// Copyright (c) 2015, Microsoft Corporation
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR
+// IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+// Coroutine support for host code that drives an INodeEngine, for example:
+//
+//     Task<std::string> GetDeviceStateAsync(INodeEngine& engine)
+//     {
+//         co_await StartAsync(engine, workingDirectory);
+//         std::string stateJson = co_await CallScriptAsync(engine, "require('device').getState()");
+//         co_await ResumeOn(threadPool);
+//         co_return stateJson;
+//     }
+//
+// Everything here requires C++20 coroutines and is compiled out otherwise, so the rest of the
+// library stays C++11. A translation unit that uses it must include <coroutine> and <optional>,
+// then these headers in this order: Log.h, CancellationToken.h, NodeValue.h, INodeEngine.h,
+// ThreadOptions.h, MpscQueue.h, RingQueue.h, FairQueue.h, AsyncQueue.h, UniqueFunction.h,
+// WorkItemDispatcher.h and ThreadPool.h. See test/benchmark/CoroutineBenchmark.cpp.
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+
+namespace OpenT2T
+{
+
+// Promise state common to Task<T> for all result types.
+struct TaskPromiseBase
+{
+    // Resumes the awaiting coroutine, if any, when the task finishes. A task that was started
+    // with Start() has no awaiter, and destroys itself instead.
+    struct FinalAwaiter
+    {
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        template <typename PromiseType>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<PromiseType> handle) noexcept
+        {
+            TaskPromiseBase& promise = handle.promise();
+            if (promise.continuation)
+            {
+                return promise.continuation;
+            }
+
+            if (promise.exception != nullptr)
+            {
+                LogError("Unhandled exception in a started task.");
+            }
+
+            handle.destroy();
+            return std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept
+        {
+        }
+    };
+
+    // Tasks are lazy: the body runs when the task is awaited or started.
+    std::suspend_always initial_suspend() const noexcept
+    {
+        return {};
+    }
+
+    FinalAwaiter final_suspend() const noexcept
+    {
+        return {};
+    }
+
+    void unhandled_exception() noexcept
+    {
+        exception = std::current_exception();
+    }
+
+    void RethrowIfFailed()
+    {
+        if (exception != nullptr)
+        {
+            std::rethrow_exception(exception);
+        }
+    }
+
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase
+{
+    void return_value(T result)
+    {
+        value.emplace(std::move(result));
+    }
+
+    T TakeResult()
+    {
+        RethrowIfFailed();
+        return std::move(*value);
+    }
+
+    std::optional<T> value;
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase
+{
+    void return_void() noexcept
+    {
+    }
+
+    void TakeResult()
+    {
+        RethrowIfFailed();
+    }
+};
+
+// A lazily started coroutine that produces a T (or throws). Awaiting a task runs it and resumes
+// the awaiter directly (without a thread hop) on whichever thread the task finishes on.
+// Move-only; destroying a task that has not been started destroys its coroutine.
+template <typename T>
+class Task
+{
+public:
+    struct promise_type : TaskPromise<T>
+    {
+        Task get_return_object() noexcept
+        {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+    };
+
+    Task(Task&& other) noexcept : _handle(other._handle)
+    {
+        other._handle = nullptr;
+    }
+
+    Task& operator=(Task&& other) noexcept
+    {
+        if (this != &other)
+        {
+            if (_handle)
+            {
+                _handle.destroy();
+            }
+
+            _handle = other._handle;
+            other._handle = nullptr;
+        }
+        return *this;
+    }
+
+    ~Task()
+    {
+        if (_handle)
+        {
+            _handle.destroy();
+        }
+    }
+
+    class Awaiter
+    {
+    public:
+        explicit Awaiter(std::coroutine_handle<promise_type> handle) noexcept : _handle(handle) { }
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaitingHandle) noexcept
+        {
+            _handle.promise().continuation = awaitingHandle;
+            return _handle;
+        }
+
+        T await_resume()
+        {
+            return _handle.promise().TakeResult();
+        }
+
+    private:
+        std::coroutine_handle<promise_type> _handle;
+    };
+
+    Awaiter operator co_await() && noexcept
+    {
+        return Awaiter(_handle);
+    }
+
+    // Runs the task without awaiting it, for starting a coroutine chain from ordinary code.
+    // The task destroys itself when it finishes; an exception that escapes it is logged.
+    void Start() &&
+    {
+        std::coroutine_handle<promise_type> handle = _handle;
+        _handle = nullptr;
+        handle.resume();
+    }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle) noexcept : _handle(handle) { }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    std::coroutine_handle<promise_type> _handle;
+};
+
+// Awaitable for INodeEngine::CallScript. The awaiting coroutine is resumed directly from the
+// engine's result callback, on the thread that invokes it. The callback only captures a
+// pointer to the awaiter, which lives in the coroutine frame, so creating it does not allocate;
+// the engine may still allocate for the copies of the callback it keeps.
+class CallScriptAwaiter
+{
+public:
+    CallScriptAwaiter(INodeEngine& engine, std::string scriptCode, const CallScriptOptions& options) :
+        _engine(engine),
+        _scriptCode(std::move(scriptCode)),
+        _options(options)
+    {
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> awaitingHandle)
+    {
+        _awaitingHandle = awaitingHandle;
+
+        // The callback may resume (and so destroy) this awaiter before CallScript returns, so
+        // nothing here may touch members after the call.
+        _engine.CallScript(std::move(_scriptCode), _options, [this](std::string resultJson, std::exception_ptr ex)
+        {
+            _resultJson = std::move(resultJson);
+            _exception = ex;
+            _awaitingHandle.resume();
+        });
+    }
+
+    std::string await_resume()
+    {
+        if (_exception != nullptr)
+        {
+            std::rethrow_exception(_exception);
+        }
+
+        return std::move(_resultJson);
+    }
+
+private:
+    INodeEngine& _engine;
+    std::string _scriptCode;
+    CallScriptOptions _options;
+    std::coroutine_handle<> _awaitingHandle;
+    std::string _resultJson;
+    std::exception_ptr _exception;
+};
+
+// Awaitable for INodeEngine::Start or Stop, resumed directly from the engine's callback.
+class EngineCompletionAwaiter
+{
+public:
+    // Starts the engine with the specified working directory.
+    EngineCompletionAwaiter(INodeEngine& engine, std::string workingDirectory) :
+        _engine(engine),
+        _isStart(true),
+        _workingDirectory(std::move(workingDirectory))
+    {
+    }
+
+    // Stops the engine.
+    explicit EngineCompletionAwaiter(INodeEngine& engine) :
+        _engine(engine),
+        _isStart(false)
+    {
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> awaitingHandle)
+    {
+        _awaitingHandle = awaitingHandle;
+
+        std::function<void(std::exception_ptr ex)> callback = [this](std::exception_ptr ex)
+        {
+            _exception = ex;
+            _awaitingHandle.resume();
+        };
+
+        if (_isStart)
+        {
+            _engine.Start(std::move(_workingDirectory), std::move(callback));
+        }
+        else
+        {
+            _engine.Stop(std::move(callback));
+        }
+    }
+
+    void await_resume()
+    {
+        if (_exception != nullptr)
+        {
+            std::rethrow_exception(_exception);
+        }
+    }
+
+private:
+    INodeEngine& _engine;
+    bool _isStart;
+    std::string _workingDirectory;
+    std::coroutine_handle<> _awaitingHandle;
+    std::exception_ptr _exception;
+};
+
+// Evaluates script code in the engine; the awaited result is the JSON result, and a script
+// error is rethrown in the awaiting coroutine.
+inline CallScriptAwaiter CallScriptAsync(
+    INodeEngine& engine,
+    std::string scriptCode,
+    const CallScriptOptions& options = CallScriptOptions())
+{
+    return CallScriptAwaiter(engine, std::move(scriptCode), options);
+}
+
+inline EngineCompletionAwaiter StartAsync(INodeEngine& engine, std::string workingDirectory)
+{
+    return EngineCompletionAwaiter(engine, std::move(workingDirectory));
+}
+
+inline EngineCompletionAwaiter StopAsync(INodeEngine& engine)
+{
+    return EngineCompletionAwaiter(engine);
+}
+
+// Awaitable that continues the awaiting coroutine on a thread pool thread. Throws
+// std::runtime_error (on the awaiting thread) if the pool has been shut down.
+class ThreadPoolResumeAwaiter
+{
+public:
+    explicit ThreadPoolResumeAwaiter(ThreadPool& threadPool) : _threadPool(threadPool), _rejected(false) { }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> awaitingHandle)
+    {
+        if (_threadPool.Submit([awaitingHandle]() { awaitingHandle.resume(); }))
+        {
+            return true;
+        }
+
+        _rejected = true;
+        return false;
+    }
+
+    void await_resume() const
+    {
+        if (_rejected)
+        {
+            throw std::runtime_error("Cannot resume on the thread pool because it has been shut down.");
+        }
+    }
+
+private:
+    ThreadPool& _threadPool;
+    bool _rejected;
+};
+
+// Awaitable that continues the awaiting coroutine on a dispatcher's worker thread, in the
+// specified lane. Throws std::runtime_error if the work item is rejected or dropped by a full
+// queue, so the coroutine is never abandoned.
+class DispatcherResumeAwaiter
+{
+public:
+    DispatcherResumeAwaiter(WorkItemDispatcher& dispatcher, size_t lane) :
+        _dispatcher(dispatcher),
+        _lane(lane),
+        _rejected(false)
+    {
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> awaitingHandle)
+    {
+        bool dispatched = _dispatcher.Dispatch(
+            [awaitingHandle]() { awaitingHandle.resume(); },
+            [this, awaitingHandle]()
+            {
+                _rejected = true;
+                awaitingHandle.resume();
+            },
+            _lane);
+        if (dispatched)
+        {
+            return true;
+        }
+
+        _rejected = true;
+        return false;
+    }
+
+    void await_resume() const
+    {
+        if (_rejected)
+        {
+            throw std::runtime_error("Cannot resume on the dispatcher because its queue is full.");
+        }
+    }
+
+private:
+    WorkItemDispatcher& _dispatcher;
+    size_t _lane;
+    bool _rejected;
+};
+
+inline ThreadPoolResumeAwaiter ResumeOn(ThreadPool& threadPool)
+{
+    return ThreadPoolResumeAwaiter(threadPool);
+}
+
+inline DispatcherResumeAwaiter ResumeOn(WorkItemDispatcher& dispatcher, size_t lane = 0)
+{
+    return DispatcherResumeAwaiter(dispatcher, lane);
+}
+
+}
+
+#endif
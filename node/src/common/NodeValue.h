@@ -0,0 +1,187 @@
+//
+// Copyright (c) 2015, Microsoft Corporation
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR
+// IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+namespace OpenT2T
+{
+
+enum class NodeValueType
+{
+    Null,
+    Boolean,
+    Int32,
+    Double,
+    String,
+    Array,
+    Object,
+
+    // JSON text, converted to a value in script (or converted from one) as a whole. Results
+    // that are arrays or objects are returned this way, since their properties cannot be
+    // enumerated from native code.
+    Json,
+};
+
+// A JavaScript value passed to or returned from INodeEngine::CallFunction, so that simple
+// arguments and results need not be formatted and parsed as JSON. Values are immutable;
+// copies of arrays and objects share their elements.
+class NodeValue
+{
+public:
+    // Creates a null value.
+    NodeValue() : _type(NodeValueType::Null), _boolean(false), _int32(0), _double(0) { }
+
+    NodeValue(bool value) : _type(NodeValueType::Boolean), _boolean(value), _int32(0), _double(0) { }
+
+    NodeValue(int32_t value) : _type(NodeValueType::Int32), _boolean(false), _int32(value), _double(0) { }
+
+    NodeValue(double value) : _type(NodeValueType::Double), _boolean(false), _int32(0), _double(value) { }
+
+    // Creates a value from any other integer type (such as size_t or int64_t): an Int32 if it is
+    // in range, otherwise a Double, which (as in JavaScript) is exact only up to 2^53.
+    template <typename IntegerType, typename = typename std::enable_if<
+        std::is_integral<IntegerType>::value &&
+        !std::is_same<IntegerType, bool>::value &&
+        !std::is_same<IntegerType, int32_t>::value>::type>
+    NodeValue(IntegerType value) :
+        _type(IsInt32(value) ? NodeValueType::Int32 : NodeValueType::Double),
+        _boolean(false),
+        _int32(IsInt32(value) ? static_cast<int32_t>(value) : 0),
+        _double(IsInt32(value) ? 0 : static_cast<double>(value))
+    {
+    }
+
+    NodeValue(std::string value) :
+        _type(NodeValueType::String), _boolean(false), _int32(0), _double(0), _string(std::move(value))
+    {
+    }
+
+    NodeValue(const char* value) :
+        _type(NodeValueType::String), _boolean(false), _int32(0), _double(0), _string(value)
+    {
+    }
+
+    static NodeValue Array(std::vector<NodeValue> items)
+    {
+        NodeValue value(NodeValueType::Array);
+        value._array = std::make_shared<std::vector<NodeValue>>(std::move(items));
+        return value;
+    }
+
+    static NodeValue Object(std::map<std::string, NodeValue> properties)
+    {
+        NodeValue value(NodeValueType::Object);
+        value._object = std::make_shared<std::map<std::string, NodeValue>>(std::move(properties));
+        return value;
+    }
+
+    static NodeValue Json(std::string json)
+    {
+        NodeValue value(NodeValueType::Json);
+        value._string = std::move(json);
+        return value;
+    }
+
+    NodeValueType GetType() const
+    {
+        return _type;
+    }
+
+    bool IsNull() const
+    {
+        return _type == NodeValueType::Null;
+    }
+
+    // The getters below throw std::logic_error if the value is of another type, except that
+    // GetDouble also accepts an Int32.
+
+    bool GetBoolean() const
+    {
+        CheckType(NodeValueType::Boolean);
+        return _boolean;
+    }
+
+    int32_t GetInt32() const
+    {
+        CheckType(NodeValueType::Int32);
+        return _int32;
+    }
+
+    double GetDouble() const
+    {
+        if (_type == NodeValueType::Int32)
+        {
+            return _int32;
+        }
+
+        CheckType(NodeValueType::Double);
+        return _double;
+    }
+
+    const std::string& GetString() const
+    {
+        CheckType(NodeValueType::String);
+        return _string;
+    }
+
+    const std::vector<NodeValue>& GetArray() const
+    {
+        CheckType(NodeValueType::Array);
+        return *_array;
+    }
+
+    const std::map<std::string, NodeValue>& GetObject() const
+    {
+        CheckType(NodeValueType::Object);
+        return *_object;
+    }
+
+    const std::string& GetJson() const
+    {
+        CheckType(NodeValueType::Json);
+        return _string;
+    }
+
+private:
+    NodeValue(NodeValueType type) : _type(type), _boolean(false), _int32(0), _double(0) { }
+
+    template <typename IntegerType>
+    static bool IsInt32(IntegerType value)
+    {
+        return (std::is_signed<IntegerType>::value ?
+            static_cast<int64_t>(value) >= INT32_MIN && static_cast<int64_t>(value) <= INT32_MAX :
+            static_cast<uint64_t>(value) <= static_cast<uint64_t>(INT32_MAX));
+    }
+
+    void CheckType(NodeValueType type) const
+    {
+        if (_type != type)
+        {
+            throw std::logic_error("Node value is not of the requested type.");
+        }
+    }
+
+    NodeValueType _type;
+    bool _boolean;
+    int32_t _int32;
+    double _double;
+
+    // The string of a String or Json value.
+    std::string _string;
+
+    std::shared_ptr<const std::vector<NodeValue>> _array;
+    std::shared_ptr<const std::map<std::string, NodeValue>> _object;
+};
+
+}
@@ -0,0 +1,127 @@
+//
+// Copyright (c) 2015, Microsoft Corporation
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR
+// IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+namespace OpenT2T
+{
+
+// Implements a FIFO queue on a growable circular buffer. Unlike std::deque or std::queue,
+// it keeps its storage when items are popped, so a queue that has reached its working
+// size pushes and pops without touching the heap. Not thread-safe.
+template <class Item>
+class RingQueue
+{
+public:
+    RingQueue() : _head(0), _count(0) { }
+
+    bool IsEmpty() const
+    {
+        return _count == 0;
+    }
+
+    size_t Size() const
+    {
+        return _count;
+    }
+
+    Item& Front()
+    {
+        return _slots[_head];
+    }
+
+    // Gets the item at a position from the front, where 0 is the oldest.
+    Item& operator[](size_t index)
+    {
+        return _slots[(_head + index) & (_slots.size() - 1)];
+    }
+
+    template <typename ItemType>
+    void Push(ItemType&& item)
+    {
+        if (_count == _slots.size())
+        {
+            Grow();
+        }
+
+        _slots[(_head + _count) & (_slots.size() - 1)] = std::forward<ItemType>(item);
+        _count++;
+    }
+
+    void Pop()
+    {
+        // Reset the slot so resources held by the popped item are released now.
+        _slots[_head] = Item();
+        _head = (_head + 1) & (_slots.size() - 1);
+        _count--;
+    }
+
+    void Clear()
+    {
+        while (_count != 0)
+        {
+            Pop();
+        }
+    }
+
+    // Removes the item at a position from the front. Items after it keep their order.
+    void RemoveAt(size_t index)
+    {
+        size_t mask = _slots.size() - 1;
+        for (; index + 1 < _count; index++)
+        {
+            _slots[(_head + index) & mask] = std::move(_slots[(_head + index + 1) & mask]);
+        }
+        _slots[(_head + index) & mask] = Item();
+        _count--;
+    }
+
+    // Removes the oldest item that satisfies the predicate. Items after it keep their order.
+    template <typename Predicate>
+    bool RemoveFirst(Predicate predicate, Item& removedItem)
+    {
+        size_t mask = _slots.size() - 1;
+        for (size_t i = 0; i < _count; i++)
+        {
+            if (predicate(_slots[(_head + i) & mask]))
+            {
+                removedItem = std::move(_slots[(_head + i) & mask]);
+                RemoveAt(i);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+private:
+    // Doubles the capacity (kept a power of two), moving items so the oldest is at slot 0.
+    void Grow()
+    {
+        std::vector<Item> slots(_slots.empty() ? 16 : _slots.size() * 2);
+        for (size_t i = 0; i < _count; i++)
+        {
+            slots[i] = std::move(_slots[(_head + i) & (_slots.size() - 1)]);
+        }
+
+        _slots.swap(slots);
+        _head = 0;
+    }
+
+    std::vector<Item> _slots;
+    size_t _head;
+    size_t _count;
+};
+
+}
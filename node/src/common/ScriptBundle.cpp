@@ -0,0 +1,517 @@
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Log.h"
+#include "ScriptBundle.h"
+
+using namespace OpenT2T;
+
+namespace
+{
+
+const char bundleMagic[8] = { 'O', 'T', '2', 'T', 'B', 'N', 'D', 'L' };
+const uint32_t bundleVersion = 1;
+const size_t headerSize = 16;
+const size_t entryRecordSize = 24;
+
+/// LZ4 block format limits: matches are at least 4 bytes, the last 5 bytes of a block are
+/// literals, and the last match starts at least 12 bytes before the end of the block.
+const size_t lz4MinMatch = 4;
+const size_t lz4LastLiterals = 5;
+const size_t lz4MatchFindLimit = 12;
+const size_t lz4MaxOffset = 65535;
+const int lz4HashBits = 12;
+
+uint32_t ReadUInt32(const uint8_t* data)
+{
+    return static_cast<uint32_t>(data[0]) |
+        (static_cast<uint32_t>(data[1]) << 8) |
+        (static_cast<uint32_t>(data[2]) << 16) |
+        (static_cast<uint32_t>(data[3]) << 24);
+}
+
+void AppendUInt32(std::string& data, uint32_t value)
+{
+    data.push_back(static_cast<char>(value & 0xFF));
+    data.push_back(static_cast<char>((value >> 8) & 0xFF));
+    data.push_back(static_cast<char>((value >> 16) & 0xFF));
+    data.push_back(static_cast<char>((value >> 24) & 0xFF));
+}
+
+void ThrowInvalidBundle(const std::string& path, const char* reason)
+{
+    std::string message = "Invalid script bundle '" + path + "': " + reason;
+    LogError(message.c_str());
+    throw std::runtime_error(message);
+}
+
+void AppendLz4Length(std::string& output, size_t length)
+{
+    while (length >= 255)
+    {
+        output.push_back(static_cast<char>(255));
+        length -= 255;
+    }
+    output.push_back(static_cast<char>(length));
+}
+
+void AppendLz4Sequence(std::string& output, const char* literals, size_t literalLength, size_t offset, size_t matchLength)
+{
+    size_t matchCode = (matchLength != 0 ? matchLength - lz4MinMatch : 0);
+    output.push_back(static_cast<char>(
+        ((literalLength < 15 ? literalLength : 15) << 4) | (matchCode < 15 ? matchCode : 15)));
+    if (literalLength >= 15)
+    {
+        AppendLz4Length(output, literalLength - 15);
+    }
+    output.append(literals, literalLength);
+
+    // The last sequence has only literals.
+    if (matchLength != 0)
+    {
+        output.push_back(static_cast<char>(offset & 0xFF));
+        output.push_back(static_cast<char>(offset >> 8));
+        if (matchCode >= 15)
+        {
+            AppendLz4Length(output, matchCode - 15);
+        }
+    }
+}
+
+/// Compresses data into an LZ4 block, taking the first match found through a hash of the next
+/// 4 bytes. That compresses scripts well enough, and decompression speed does not depend on it.
+std::string CompressLz4(const std::string& input)
+{
+    std::string output;
+    const char* data = input.data();
+    size_t size = input.size();
+    size_t anchor = 0;
+
+    if (size > lz4MatchFindLimit)
+    {
+        // Positions (plus 1, so 0 means none) of recent 4-byte sequences, by hash.
+        std::vector<uint32_t> table(static_cast<size_t>(1) << lz4HashBits, 0);
+        size_t matchEndLimit = size - lz4LastLiterals;
+        size_t position = 0;
+        while (position + lz4MatchFindLimit <= size)
+        {
+            uint32_t sequence;
+            std::memcpy(&sequence, data + position, sizeof(sequence));
+            size_t hash = (sequence * 2654435761u) >> (32 - lz4HashBits);
+            size_t candidate = table[hash];
+            table[hash] = static_cast<uint32_t>(position + 1);
+
+            if (candidate == 0 || position - (candidate - 1) > lz4MaxOffset ||
+                std::memcmp(data + candidate - 1, data + position, lz4MinMatch) != 0)
+            {
+                position++;
+                continue;
+            }
+
+            size_t matchPosition = candidate - 1;
+            size_t matchLength = lz4MinMatch;
+            while (position + matchLength < matchEndLimit && data[matchPosition + matchLength] == data[position + matchLength])
+            {
+                matchLength++;
+            }
+
+            AppendLz4Sequence(output, data + anchor, position - anchor, position - matchPosition, matchLength);
+            position += matchLength;
+            anchor = position;
+        }
+    }
+
+    AppendLz4Sequence(output, data + anchor, size - anchor, 0, 0);
+    return output;
+}
+
+/// Reads an LZ4 length continuation; returns false if it runs past the end of the input.
+bool ReadLz4Length(const uint8_t* input, size_t inputSize, size_t& position, size_t& length)
+{
+    uint8_t byte;
+    do
+    {
+        if (position >= inputSize)
+        {
+            return false;
+        }
+        byte = input[position++];
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+/// Decompresses an LZ4 block into exactly outputSize bytes. Returns false if the block is
+/// corrupt, without reading or writing outside the buffers.
+bool DecompressLz4(const uint8_t* input, size_t inputSize, char* output, size_t outputSize)
+{
+    size_t inputPosition = 0;
+    size_t outputPosition = 0;
+    while (true)
+    {
+        if (inputPosition >= inputSize)
+        {
+            return false;
+        }
+
+        uint8_t token = input[inputPosition++];
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !ReadLz4Length(input, inputSize, inputPosition, literalLength))
+        {
+            return false;
+        }
+
+        if (literalLength > inputSize - inputPosition || literalLength > outputSize - outputPosition)
+        {
+            return false;
+        }
+
+        std::memcpy(output + outputPosition, input + inputPosition, literalLength);
+        inputPosition += literalLength;
+        outputPosition += literalLength;
+
+        if (inputPosition == inputSize)
+        {
+            break;
+        }
+
+        if (inputSize - inputPosition < 2)
+        {
+            return false;
+        }
+
+        size_t offset = input[inputPosition] | (static_cast<size_t>(input[inputPosition + 1]) << 8);
+        inputPosition += 2;
+        if (offset == 0 || offset > outputPosition)
+        {
+            return false;
+        }
+
+        size_t matchLength = token & 0x0F;
+        if (matchLength == 15 && !ReadLz4Length(input, inputSize, inputPosition, matchLength))
+        {
+            return false;
+        }
+
+        matchLength += lz4MinMatch;
+        if (matchLength > outputSize - outputPosition)
+        {
+            return false;
+        }
+
+        // The match may overlap the bytes it produces, so copy it forward a byte at a time.
+        for (size_t i = 0; i < matchLength; i++, outputPosition++)
+        {
+            output[outputPosition] = output[outputPosition - offset];
+        }
+    }
+
+    return outputPosition == outputSize;
+}
+
+}
+
+#if defined(_WIN32)
+
+struct ScriptBundle::MappedFile
+{
+    MappedFile() : fileHandle(INVALID_HANDLE_VALUE), mappingHandle(nullptr), data(nullptr), size(0) { }
+
+    ~MappedFile()
+    {
+        if (data != nullptr)
+        {
+            UnmapViewOfFile(data);
+        }
+        if (mappingHandle != nullptr)
+        {
+            CloseHandle(mappingHandle);
+        }
+        if (fileHandle != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(fileHandle);
+        }
+    }
+
+    bool Map(const std::string& path)
+    {
+        int pathLength = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+        if (pathLength == 0)
+        {
+            return false;
+        }
+
+        std::vector<wchar_t> widePath(pathLength);
+        MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, widePath.data(), pathLength);
+
+        fileHandle = CreateFile2(widePath.data(), GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, nullptr);
+        LARGE_INTEGER fileSize;
+        if (fileHandle == INVALID_HANDLE_VALUE || !GetFileSizeEx(fileHandle, &fileSize) ||
+            fileSize.QuadPart <= 0 || fileSize.QuadPart > UINT32_MAX)
+        {
+            return false;
+        }
+
+        size = static_cast<size_t>(fileSize.QuadPart);
+        mappingHandle = CreateFileMappingFromApp(fileHandle, nullptr, PAGE_READONLY, 0, nullptr);
+        if (mappingHandle == nullptr)
+        {
+            return false;
+        }
+
+        data = static_cast<const uint8_t*>(MapViewOfFileFromApp(mappingHandle, FILE_MAP_READ, 0, 0));
+        return data != nullptr;
+    }
+
+    HANDLE fileHandle;
+    HANDLE mappingHandle;
+    const uint8_t* data;
+    size_t size;
+};
+
+#else
+
+struct ScriptBundle::MappedFile
+{
+    MappedFile() : data(nullptr), size(0) { }
+
+    ~MappedFile()
+    {
+        if (data != nullptr)
+        {
+            munmap(const_cast<uint8_t*>(data), size);
+        }
+    }
+
+    bool Map(const std::string& path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        // The mapping keeps the file open, so the descriptor is not needed after mapping it.
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) != 0 || fileStat.st_size <= 0 || fileStat.st_size > UINT32_MAX)
+        {
+            close(fd);
+            return false;
+        }
+
+        size = static_cast<size_t>(fileStat.st_size);
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED)
+        {
+            return false;
+        }
+
+        data = static_cast<const uint8_t*>(mapping);
+        return true;
+    }
+
+    const uint8_t* data;
+    size_t size;
+};
+
+#endif
+
+ScriptBundle::ScriptBundle(const std::string& path) :
+    _path(path),
+    _file(new MappedFile())
+{
+    if (!_file->Map(path))
+    {
+        std::string message = "Failed to map script bundle '" + path + "'.";
+        LogError(message.c_str());
+        throw std::runtime_error(message);
+    }
+
+    const uint8_t* data = _file->data;
+    size_t size = _file->size;
+    if (size < headerSize || std::memcmp(data, bundleMagic, sizeof(bundleMagic)) != 0)
+    {
+        ThrowInvalidBundle(path, "not a script bundle.");
+    }
+
+    if (ReadUInt32(data + 8) != bundleVersion)
+    {
+        ThrowInvalidBundle(path, "unsupported version.");
+    }
+
+    size_t entryCount = ReadUInt32(data + 12);
+    if (entryCount > (size - headerSize) / entryRecordSize)
+    {
+        ThrowInvalidBundle(path, "truncated index.");
+    }
+
+    _entries.reserve(entryCount);
+    _entryIndexes.reserve(entryCount);
+    for (size_t i = 0; i < entryCount; i++)
+    {
+        const uint8_t* record = data + headerSize + i * entryRecordSize;
+        size_t nameOffset = ReadUInt32(record);
+        size_t nameLength = ReadUInt32(record + 4);
+
+        ScriptBundleEntry entry;
+        entry.offset = ReadUInt32(record + 8);
+        entry.storedSize = ReadUInt32(record + 12);
+        entry.size = ReadUInt32(record + 16);
+        entry.compression = static_cast<ScriptBundleCompression>(ReadUInt32(record + 20));
+
+        if (nameLength == 0 || nameOffset > size || nameLength > size - nameOffset ||
+            entry.offset > size || entry.storedSize > size - entry.offset)
+        {
+            ThrowInvalidBundle(path, "entry out of range.");
+        }
+
+        if (entry.compression != ScriptBundleCompression::None && entry.compression != ScriptBundleCompression::Lz4)
+        {
+            ThrowInvalidBundle(path, "unsupported compression.");
+        }
+
+        if (entry.compression == ScriptBundleCompression::None && entry.storedSize != entry.size)
+        {
+            ThrowInvalidBundle(path, "entry size mismatch.");
+        }
+
+        entry.name.assign(reinterpret_cast<const char*>(data + nameOffset), nameLength);
+        if (!_entryIndexes.emplace(entry.name, i).second)
+        {
+            ThrowInvalidBundle(path, "duplicate entry name.");
+        }
+
+        _entries.push_back(std::move(entry));
+    }
+
+    LogVerbose("Mapped script bundle '%s' with %u scripts.", path.c_str(), static_cast<unsigned int>(entryCount));
+}
+
+ScriptBundle::~ScriptBundle()
+{
+}
+
+const ScriptBundleEntry* ScriptBundle::FindEntry(const std::string& name) const
+{
+    std::unordered_map<std::string, size_t>::const_iterator entryIndex = _entryIndexes.find(name);
+    return (entryIndex != _entryIndexes.end() ? &_entries[entryIndex->second] : nullptr);
+}
+
+std::string ScriptBundle::ReadScript(const ScriptBundleEntry& entry) const
+{
+    const uint8_t* storedScript = _file->data + entry.offset;
+    if (entry.compression == ScriptBundleCompression::None)
+    {
+        return std::string(reinterpret_cast<const char*>(storedScript), entry.size);
+    }
+
+    std::string scriptCode(entry.size, '\0');
+    if (!DecompressLz4(storedScript, entry.storedSize, &scriptCode[0], scriptCode.size()))
+    {
+        ThrowInvalidBundle(_path, "corrupt compressed script.");
+    }
+    return scriptCode;
+}
+
+void ScriptBundle::Write(
+    const std::string& path,
+    const std::vector<std::pair<std::string, std::string>>& scripts,
+    ScriptBundleCompression compression)
+{
+    std::unordered_set<std::string> names;
+    std::vector<std::string> storedScripts;
+    std::vector<ScriptBundleCompression> compressions;
+    size_t namesSize = 0;
+    size_t storedScriptsSize = 0;
+    for (const std::pair<std::string, std::string>& script : scripts)
+    {
+        if (script.first.empty() || !names.insert(script.first).second)
+        {
+            throw std::invalid_argument("Script names in a bundle must be non-empty and unique.");
+        }
+
+        std::string compressedScript;
+        if (compression == ScriptBundleCompression::Lz4)
+        {
+            compressedScript = CompressLz4(script.second);
+        }
+
+        if (compression == ScriptBundleCompression::Lz4 && compressedScript.size() < script.second.size())
+        {
+            storedScripts.push_back(std::move(compressedScript));
+            compressions.push_back(ScriptBundleCompression::Lz4);
+        }
+        else
+        {
+            storedScripts.push_back(script.second);
+            compressions.push_back(ScriptBundleCompression::None);
+        }
+
+        namesSize += script.first.size();
+        storedScriptsSize += storedScripts.back().size();
+    }
+
+    size_t namesOffset = headerSize + scripts.size() * entryRecordSize;
+    if (namesOffset + namesSize + storedScriptsSize > UINT32_MAX)
+    {
+        throw std::invalid_argument("Script bundle is too large.");
+    }
+
+    std::string header(bundleMagic, sizeof(bundleMagic));
+    AppendUInt32(header, bundleVersion);
+    AppendUInt32(header, static_cast<uint32_t>(scripts.size()));
+
+    size_t nameOffset = namesOffset;
+    size_t storedScriptOffset = namesOffset + namesSize;
+    for (size_t i = 0; i < scripts.size(); i++)
+    {
+        AppendUInt32(header, static_cast<uint32_t>(nameOffset));
+        AppendUInt32(header, static_cast<uint32_t>(scripts[i].first.size()));
+        AppendUInt32(header, static_cast<uint32_t>(storedScriptOffset));
+        AppendUInt32(header, static_cast<uint32_t>(storedScripts[i].size()));
+        AppendUInt32(header, static_cast<uint32_t>(scripts[i].second.size()));
+        AppendUInt32(header, static_cast<uint32_t>(compressions[i]));
+        nameOffset += scripts[i].first.size();
+        storedScriptOffset += storedScripts[i].size();
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(header.data(), header.size());
+    for (const std::pair<std::string, std::string>& script : scripts)
+    {
+        file.write(script.first.data(), script.first.size());
+    }
+    for (const std::string& storedScript : storedScripts)
+    {
+        file.write(storedScript.data(), storedScript.size());
+    }
+
+    file.close();
+    if (!file)
+    {
+        std::string message = "Failed to write script bundle '" + path + "'.";
+        LogError(message.c_str());
+        throw std::runtime_error(message);
+    }
+}
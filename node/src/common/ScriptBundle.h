@@ -0,0 +1,91 @@
+//
+// Copyright (c) 2015, Microsoft Corporation
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR
+// IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+namespace OpenT2T
+{
+
+enum class ScriptBundleCompression : uint32_t
+{
+    None = 0,
+
+    // The LZ4 block format, without a frame.
+    Lz4 = 1,
+};
+
+// A script file in a bundle, located by its offset and stored size in the bundle file.
+struct ScriptBundleEntry
+{
+    std::string name;
+    ScriptBundleCompression compression;
+    uint32_t offset;
+    uint32_t storedSize;
+    uint32_t size;
+};
+
+// A file holding many script files, which is memory-mapped so that only the scripts that are
+// read take up memory (and only while they are read), rather than all of them.
+//
+// The file starts with a 16-byte header: the magic "OT2TBNDL", then the format version (1) and
+// the entry count as little-endian uint32s. A 24-byte record for each entry follows: the offsets
+// and lengths of its name and stored script, its uncompressed size and its compression, all
+// little-endian uint32s (offsets are from the start of the file). The names and the stored
+// scripts follow the records. Names are UTF-8 and unique.
+class ScriptBundle
+{
+public:
+    // Maps a bundle file and reads its index. Throws std::runtime_error if the file cannot be
+    // mapped or is not a valid bundle.
+    explicit ScriptBundle(const std::string& path);
+    ~ScriptBundle();
+
+    ScriptBundle(const ScriptBundle&) = delete;
+    ScriptBundle& operator=(const ScriptBundle&) = delete;
+
+    const std::string& GetPath() const
+    {
+        return _path;
+    }
+
+    const std::vector<ScriptBundleEntry>& GetEntries() const
+    {
+        return _entries;
+    }
+
+    // Gets the entry with the name, or nullptr if there is none.
+    const ScriptBundleEntry* FindEntry(const std::string& name) const;
+
+    // Reads an entry's script code, decompressing it if necessary. Throws std::runtime_error if
+    // the stored script is corrupt.
+    std::string ReadScript(const ScriptBundleEntry& entry) const;
+
+    // Writes a bundle file holding the scripts, as (name, code) pairs. With Lz4 compression, a
+    // script that does not get smaller is stored uncompressed. Throws std::invalid_argument if
+    // names are empty or not unique, or std::runtime_error if the file cannot be written.
+    static void Write(
+        const std::string& path,
+        const std::vector<std::pair<std::string, std::string>>& scripts,
+        ScriptBundleCompression compression);
+
+private:
+    struct MappedFile;
+
+    std::string _path;
+    std::unique_ptr<MappedFile> _file;
+    std::vector<ScriptBundleEntry> _entries;
+    std::unordered_map<std::string, size_t> _entryIndexes;
+};
+
+}
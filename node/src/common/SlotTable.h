@@ -0,0 +1,177 @@
+//
+// Copyright (c) 2015, Microsoft Corporation
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR
+// IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+namespace OpenT2T
+{
+
+// Stores values in a dense array of reusable slots, identified by positive int32 IDs that
+// can be passed through JavaScript as plain numbers. An ID combines the slot index with a
+// generation that changes each time the slot is reused, so a stale ID (of a value that was
+// removed) is not mistaken for the slot's current value. Slots freed by Take or Remove are
+// reused before the array grows, so once it has grown to the peak number of values, adding
+// one does not allocate. Not thread-safe.
+template <class Value>
+class SlotTable
+{
+public:
+    // Bits of an ID holding the slot index; the remaining bits (except the sign bit) hold the
+    // generation, so a slot can be reused 2047 times before an old ID could match it again.
+    static const int IndexBits = 20;
+    static const size_t MaxSize = (static_cast<size_t>(1) << IndexBits);
+
+    SlotTable() : _size(0) { }
+
+    size_t GetSize() const
+    {
+        return _size;
+    }
+
+    bool IsEmpty() const
+    {
+        return _size == 0;
+    }
+
+    // Stores a value and returns its ID, which is never 0. Throws std::length_error if the
+    // table already holds MaxSize values.
+    int32_t Insert(Value&& value)
+    {
+        uint32_t index;
+        if (!_freeIndexes.empty())
+        {
+            index = _freeIndexes.back();
+            _freeIndexes.pop_back();
+        }
+        else if (_slots.size() < MaxSize)
+        {
+            index = static_cast<uint32_t>(_slots.size());
+            _slots.emplace_back();
+        }
+        else
+        {
+            throw std::length_error("Slot table is full.");
+        }
+
+        Slot& slot = _slots[index];
+        slot.value = std::move(value);
+        slot.occupied = true;
+        _size++;
+        return MakeId(index, slot.generation);
+    }
+
+    // Returns the value with the ID, or nullptr if there is none. The pointer is valid until
+    // the table is next changed.
+    Value* Find(int32_t id)
+    {
+        Slot* slot = FindSlot(id);
+        return (slot != nullptr ? &slot->value : nullptr);
+    }
+
+    // Moves the value with the ID out of the table, freeing its slot. Returns false if there
+    // is no such value.
+    bool Take(int32_t id, Value& value)
+    {
+        Slot* slot = FindSlot(id);
+        if (slot == nullptr)
+        {
+            return false;
+        }
+
+        value = std::move(slot->value);
+        Free(id, *slot);
+        return true;
+    }
+
+    bool Remove(int32_t id)
+    {
+        Slot* slot = FindSlot(id);
+        if (slot == nullptr)
+        {
+            return false;
+        }
+
+        Free(id, *slot);
+        return true;
+    }
+
+    // Gets the IDs of all values in the table.
+    std::vector<int32_t> GetIds() const
+    {
+        std::vector<int32_t> ids;
+        ids.reserve(_size);
+        for (size_t index = 0; index < _slots.size(); index++)
+        {
+            if (_slots[index].occupied)
+            {
+                ids.push_back(MakeId(static_cast<uint32_t>(index), _slots[index].generation));
+            }
+        }
+        return ids;
+    }
+
+private:
+    static const uint32_t IndexMask = (1u << IndexBits) - 1;
+    static const uint32_t GenerationMask = (1u << (31 - IndexBits)) - 1;
+
+    struct Slot
+    {
+        Slot() : value(), generation(1), occupied(false) { }
+
+        Value value;
+        uint32_t generation;
+        bool occupied;
+    };
+
+    static int32_t MakeId(uint32_t index, uint32_t generation)
+    {
+        return static_cast<int32_t>((generation << IndexBits) | index);
+    }
+
+    Slot* FindSlot(int32_t id)
+    {
+        if (id <= 0)
+        {
+            return nullptr;
+        }
+
+        uint32_t index = static_cast<uint32_t>(id) & IndexMask;
+        uint32_t generation = static_cast<uint32_t>(id) >> IndexBits;
+        if (index >= _slots.size() || !_slots[index].occupied || _slots[index].generation != generation)
+        {
+            return nullptr;
+        }
+
+        return &_slots[index];
+    }
+
+    void Free(int32_t id, Slot& slot)
+    {
+        // Release whatever the value holds now, rather than when the slot is next reused.
+        slot.value = Value();
+        slot.occupied = false;
+
+        // Generation 0 is skipped so that an ID is never 0.
+        slot.generation = (slot.generation < GenerationMask ? slot.generation + 1 : 1);
+
+        _freeIndexes.push_back(static_cast<uint32_t>(id) & IndexMask);
+        _size--;
+    }
+
+    std::vector<Slot> _slots;
+    std::vector<uint32_t> _freeIndexes;
+    size_t _size;
+};
+
+}
@@ -0,0 +1,289 @@
+
+#include <cerrno>
+#include <climits>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "Log.h"
+#include "ThreadOptions.h"
+
+using namespace OpenT2T;
+
+#if defined(_WIN32)
+
+struct NativeThread::Handle
+{
+    std::thread thread;
+};
+
+#else
+
+struct NativeThread::Handle
+{
+    pthread_t thread;
+};
+
+/// State handed to a new thread. It lives on the stack of NativeThread::Start, which waits
+/// until the thread has taken what it needs.
+struct ThreadStartContext
+{
+    ThreadStartContext(const ThreadOptions& options, std::function<void()>&& function) :
+        options(options),
+        function(std::move(function)),
+        isStarted(false)
+    {
+    }
+
+    ThreadOptions options;
+    std::function<void()> function;
+    std::mutex mutex;
+    std::condition_variable started;
+    bool isStarted;
+    std::thread::id id;
+};
+
+static void* RunThread(void* arg)
+{
+    ThreadStartContext* context = static_cast<ThreadStartContext*>(arg);
+    ThreadOptions options = std::move(context->options);
+    std::function<void()> function = std::move(context->function);
+
+    {
+        // Notify while holding the lock: the context is destroyed as soon as Start sees isStarted.
+        std::lock_guard<std::mutex> lock(context->mutex);
+        context->id = std::this_thread::get_id();
+        context->isStarted = true;
+        context->started.notify_one();
+    }
+
+    NativeThread::ApplyToCurrentThread(options);
+    function();
+    return nullptr;
+}
+
+#endif
+
+NativeThread::NativeThread()
+{
+}
+
+NativeThread::~NativeThread()
+{
+    if (Joinable())
+    {
+        LogError("NativeThread destroyed while still joinable; detaching the thread.");
+        Detach();
+    }
+}
+
+void NativeThread::Start(const ThreadOptions& options, std::function<void()> function)
+{
+    if (Joinable())
+    {
+        throw std::logic_error("The thread has already been started.");
+    }
+
+#if defined(_WIN32)
+    if (options.stackSize != 0)
+    {
+        LogWarning("Thread stack size is not supported on this platform.");
+    }
+
+    std::unique_ptr<Handle> handle(new Handle());
+    handle->thread = std::thread([options, function]()
+    {
+        NativeThread::ApplyToCurrentThread(options);
+        function();
+    });
+    _id = handle->thread.get_id();
+    _handle = std::move(handle);
+#else
+    ThreadStartContext context(options, std::move(function));
+
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    if (options.stackSize != 0)
+    {
+        size_t minimumStackSize = static_cast<size_t>(PTHREAD_STACK_MIN);
+        size_t stackSize = (options.stackSize < minimumStackSize ? minimumStackSize : options.stackSize);
+        int result = pthread_attr_setstacksize(&attributes, stackSize);
+        if (result != 0)
+        {
+            LogWarning("Failed to set thread stack size to %lu bytes (error %d).",
+                static_cast<unsigned long>(stackSize), result);
+        }
+    }
+
+    std::unique_ptr<Handle> handle(new Handle());
+    int result = pthread_create(&handle->thread, &attributes, &RunThread, &context);
+    pthread_attr_destroy(&attributes);
+    if (result != 0)
+    {
+        throw std::system_error(result, std::system_category(), "Failed to create thread.");
+    }
+
+    std::unique_lock<std::mutex> lock(context.mutex);
+    context.started.wait(lock, [&context] { return context.isStarted; });
+    _id = context.id;
+    _handle = std::move(handle);
+#endif
+}
+
+bool NativeThread::Joinable() const
+{
+    return _handle != nullptr;
+}
+
+void NativeThread::Join()
+{
+    if (!Joinable())
+    {
+        throw std::logic_error("The thread is not joinable.");
+    }
+
+#if defined(_WIN32)
+    _handle->thread.join();
+#else
+    int result = pthread_join(_handle->thread, nullptr);
+    if (result != 0)
+    {
+        throw std::system_error(result, std::system_category(), "Failed to join thread.");
+    }
+#endif
+
+    _handle.reset();
+    _id = std::thread::id();
+}
+
+void NativeThread::Detach()
+{
+    if (!Joinable())
+    {
+        throw std::logic_error("The thread is not joinable.");
+    }
+
+#if defined(_WIN32)
+    _handle->thread.detach();
+#else
+    pthread_detach(_handle->thread);
+#endif
+
+    _handle.reset();
+    _id = std::thread::id();
+}
+
+std::thread::id NativeThread::GetId() const
+{
+    return _id;
+}
+
+void NativeThread::ApplyToCurrentThread(const ThreadOptions& options)
+{
+#if defined(__linux__)
+    // Includes Android.
+    if (!options.name.empty())
+    {
+        int result = pthread_setname_np(pthread_self(), options.name.substr(0, 15).c_str());
+        if (result != 0)
+        {
+            LogWarning("Failed to set thread name \"%s\" (error %d).", options.name.c_str(), result);
+        }
+    }
+
+    if (!options.cpuAffinity.empty())
+    {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        for (unsigned int cpu : options.cpuAffinity)
+        {
+            if (cpu < CPU_SETSIZE)
+            {
+                CPU_SET(cpu, &cpuSet);
+            }
+        }
+
+        if (sched_setaffinity(0, sizeof(cpuSet), &cpuSet) != 0)
+        {
+            LogWarning("Failed to set thread CPU affinity (error %d).", errno);
+        }
+    }
+#elif defined(__APPLE__)
+    if (!options.name.empty())
+    {
+        pthread_setname_np(options.name.c_str());
+    }
+
+    if (!options.cpuAffinity.empty())
+    {
+        LogWarning("Thread CPU affinity is not supported on this platform.");
+    }
+#else
+    if (!options.name.empty() || !options.cpuAffinity.empty())
+    {
+        LogWarning("Thread names and CPU affinity are not supported on this platform.");
+    }
+#endif
+
+#if defined(_WIN32)
+    // Windows has priority classes rather than nice values; map onto the nearest one.
+    if (options.schedulingPolicy != ThreadSchedulingPolicy::Default || options.priority != 0)
+    {
+        int priority =
+            options.schedulingPolicy != ThreadSchedulingPolicy::Default ? THREAD_PRIORITY_TIME_CRITICAL :
+            options.priority <= -10 ? THREAD_PRIORITY_HIGHEST :
+            options.priority < 0 ? THREAD_PRIORITY_ABOVE_NORMAL :
+            options.priority < 10 ? THREAD_PRIORITY_BELOW_NORMAL :
+            THREAD_PRIORITY_LOWEST;
+        if (!SetThreadPriority(GetCurrentThread(), priority))
+        {
+            LogWarning("Failed to set thread priority (error %lu).", GetLastError());
+        }
+    }
+#else
+    if (options.schedulingPolicy == ThreadSchedulingPolicy::Default)
+    {
+        if (options.priority != 0)
+        {
+#if defined(__linux__)
+            // Linux keeps a nice value per thread, addressed by the kernel thread ID.
+            if (setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), options.priority) != 0)
+            {
+                LogWarning("Failed to set thread nice value %d (error %d).", options.priority, errno);
+            }
+#else
+            LogWarning("Per-thread nice values are not supported on this platform.");
+#endif
+        }
+    }
+    else
+    {
+        sched_param parameters;
+        std::memset(&parameters, 0, sizeof(parameters));
+        parameters.sched_priority = options.priority;
+        int policy = (options.schedulingPolicy == ThreadSchedulingPolicy::Fifo ? SCHED_FIFO : SCHED_RR);
+        int result = pthread_setschedparam(pthread_self(), policy, &parameters);
+        if (result != 0)
+        {
+            LogWarning("Failed to set real-time thread scheduling (error %d).", result);
+        }
+    }
+#endif
+}
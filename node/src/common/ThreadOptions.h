@@ -0,0 +1,94 @@
+//
+// Copyright (c) 2015, Microsoft Corporation
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR
+// IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+namespace OpenT2T
+{
+
+// Selects the OS scheduling policy of a thread started with ThreadOptions.
+enum class ThreadSchedulingPolicy
+{
+    // The platform's normal time-sharing policy. ThreadOptions::priority is a nice value.
+    Default,
+
+    // Real-time policies (POSIX SCHED_FIFO and SCHED_RR). ThreadOptions::priority is the
+    // real-time priority. These usually require elevated privileges.
+    Fifo,
+    RoundRobin,
+};
+
+// Options for creating a thread. The defaults leave everything as the platform would.
+// Options that the platform does not support, or that the process is not permitted to
+// set, are logged as warnings and otherwise ignored.
+struct ThreadOptions
+{
+    ThreadOptions() :
+        schedulingPolicy(ThreadSchedulingPolicy::Default),
+        priority(0),
+        stackSize(0)
+    {
+    }
+
+    // Name shown by debuggers and tools such as top. Linux and Android truncate it to
+    // 15 characters, and on Apple platforms it is only set for the calling thread.
+    std::string name;
+
+    // Indexes of the CPUs the thread may run on, or empty to allow any CPU.
+    // Supported on Linux and Android.
+    std::vector<unsigned int> cpuAffinity;
+
+    ThreadSchedulingPolicy schedulingPolicy;
+
+    // With the Default policy, a nice value from -20 (highest priority) to 19, where 0
+    // leaves the priority unchanged; with a real-time policy, the real-time priority.
+    int priority;
+
+    // Stack size in bytes, or 0 for the platform default. Not supported on Windows.
+    size_t stackSize;
+};
+
+// A thread started with ThreadOptions. Like std::thread, it should be joined or detached
+// before it is destroyed or started again; one that is still joinable when destroyed is
+// detached (and an error logged) rather than terminating the process.
+class NativeThread
+{
+public:
+    NativeThread();
+    ~NativeThread();
+
+    // Starts a thread that applies the options to itself and then runs the function.
+    // Throws std::system_error if the thread could not be created.
+    void Start(const ThreadOptions& options, std::function<void()> function);
+
+    bool Joinable() const;
+    void Join();
+    void Detach();
+
+    // Gets the ID of the running thread, or a default ID if not joinable.
+    std::thread::id GetId() const;
+
+    // Applies the options (other than the stack size) to the calling thread.
+    static void ApplyToCurrentThread(const ThreadOptions& options);
+
+private:
+    NativeThread(const NativeThread&) = delete;
+    NativeThread& operator=(const NativeThread&) = delete;
+
+    struct Handle;
+    std::unique_ptr<Handle> _handle;
+    std::thread::id _id;
+};
+
+}
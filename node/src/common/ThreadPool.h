@@ -0,0 +1,249 @@
+//
+// Copyright (c) 2015, Microsoft Corporation
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR
+// IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+namespace OpenT2T
+{
+
+// General-purpose pool of worker threads for work that does not need the node engine's
+// thread, such as post-processing results or completing platform callbacks.
+// Each worker has its own task deque. Tasks submitted from outside the pool are spread
+// round-robin over the workers; tasks submitted from a pool thread go on that thread's own
+// deque. A worker runs its own tasks in order, and when it runs out it steals the newest
+// task from another worker, so a burst submitted to one worker is shared by all of them.
+class ThreadPool
+{
+public:
+    using TaskType = UniqueFunction<void()>;
+
+    // Starts the specified number of worker threads, or one per hardware thread if 0.
+    ThreadPool(size_t threadCount = 0) :
+        _pendingCount(0),
+        _idleCount(0),
+        _nextWorker(0),
+        _accepting(true),
+        _stopping(false)
+    {
+        if (threadCount == 0)
+        {
+            threadCount = std::thread::hardware_concurrency();
+            if (threadCount == 0)
+            {
+                threadCount = 1;
+            }
+        }
+
+        _workers.reserve(threadCount);
+        for (size_t i = 0; i < threadCount; i++)
+        {
+            _workers.push_back(std::unique_ptr<Worker>(new Worker()));
+        }
+
+        for (size_t i = 0; i < threadCount; i++)
+        {
+            _workers[i]->thread = std::thread(&ThreadPool::RunWorker, this, i);
+        }
+    }
+
+    ~ThreadPool()
+    {
+        Shutdown();
+    }
+
+    // Queues a task to run on a pool thread. Returns false and no-ops after Shutdown; a task
+    // submitted while Shutdown is in progress may be discarded without running.
+    bool Submit(TaskType&& task)
+    {
+        if (task == nullptr)
+        {
+            return true;
+        }
+
+        if (!_accepting.load())
+        {
+            return false;
+        }
+
+        size_t workerIndex = GetCurrentWorkerIndex();
+        if (workerIndex == NoWorker)
+        {
+            workerIndex = _nextWorker.fetch_add(1, std::memory_order_relaxed) % _workers.size();
+        }
+
+        // Count the task before publishing it so the count never drops below the number of
+        // tasks in the deques. Workers register as idle before re-checking the pending count,
+        // and this checks the idle count after counting the task, so at least one side always
+        // sees the other.
+        _pendingCount.fetch_add(1);
+
+        Worker& worker = *_workers[workerIndex];
+        {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.tasks.push_back(std::move(task));
+        }
+
+        if (_idleCount.load() != 0)
+        {
+            std::lock_guard<std::mutex> lock(_idleMutex);
+            _taskAvailable.notify_one();
+        }
+
+        return true;
+    }
+
+    // Stops accepting tasks, waits for the already-queued tasks to finish, and stops the
+    // worker threads. Must not be called from a pool thread.
+    void Shutdown()
+    {
+        if (!_accepting.exchange(false))
+        {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_idleMutex);
+            _stopping = true;
+            _taskAvailable.notify_all();
+        }
+
+        for (std::unique_ptr<Worker>& worker : _workers)
+        {
+            if (worker->thread.joinable())
+            {
+                worker->thread.join();
+            }
+        }
+    }
+
+    size_t GetThreadCount() const
+    {
+        return _workers.size();
+    }
+
+    // Gets the number of tasks that are queued and not yet started.
+    size_t GetPendingCount() const
+    {
+        return _pendingCount.load(std::memory_order_relaxed);
+    }
+
+    // Returns true if called from one of this pool's worker threads.
+    bool IsPoolThread() const
+    {
+        return GetCurrentWorkerIndex() != NoWorker;
+    }
+
+private:
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    static const size_t NoWorker = static_cast<size_t>(-1);
+
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<TaskType> tasks;
+        std::thread thread;
+    };
+
+    size_t GetCurrentWorkerIndex() const
+    {
+        std::thread::id currentThreadId = std::this_thread::get_id();
+        for (size_t i = 0; i < _workers.size(); i++)
+        {
+            if (_workers[i]->thread.get_id() == currentThreadId)
+            {
+                return i;
+            }
+        }
+        return NoWorker;
+    }
+
+    // Takes the oldest task from the worker's own deque, or else steals the newest task
+    // from the next worker that has one.
+    bool TryTakeTask(size_t workerIndex, TaskType& task)
+    {
+        for (size_t i = 0; i < _workers.size(); i++)
+        {
+            Worker& worker = *_workers[(workerIndex + i) % _workers.size()];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            if (!worker.tasks.empty())
+            {
+                if (i == 0)
+                {
+                    task = std::move(worker.tasks.front());
+                    worker.tasks.pop_front();
+                }
+                else
+                {
+                    task = std::move(worker.tasks.back());
+                    worker.tasks.pop_back();
+                }
+
+                _pendingCount.fetch_sub(1);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void RunWorker(size_t workerIndex)
+    {
+        for (;;)
+        {
+            TaskType task;
+            if (TryTakeTask(workerIndex, task))
+            {
+                try
+                {
+                    task();
+                }
+                catch (...)
+                {
+                    LogWarning("Caught exception while running thread pool task.");
+                }
+                continue;
+            }
+
+            if (_pendingCount.load() != 0)
+            {
+                // A task has been counted but is still being published or taken; look again.
+                std::this_thread::yield();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(_idleMutex);
+            if (_stopping)
+            {
+                return;
+            }
+
+            _idleCount.fetch_add(1);
+            _taskAvailable.wait(lock, [this] { return _pendingCount.load() != 0 || _stopping; });
+            _idleCount.fetch_sub(1);
+        }
+    }
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::atomic<size_t> _pendingCount;
+    std::atomic<size_t> _idleCount;
+    std::atomic<size_t> _nextWorker;
+    std::atomic<bool> _accepting;
+    bool _stopping;
+    std::mutex _idleMutex;
+    std::condition_variable _taskAvailable;
+};
+
+}
@@ -0,0 +1,230 @@
+//
+// Copyright (c) 2015, Microsoft Corporation
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR
+// IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+namespace OpenT2T
+{
+
+template <typename Signature, size_t InlineSize = 128>
+class UniqueFunction;
+
+// Move-only counterpart of std::function. Callable objects up to InlineSize bytes are
+// stored inside the UniqueFunction itself, so wrapping a typical lambda (which may
+// capture strings and other std::functions) does not allocate; larger ones fall back
+// to the heap. Stored callables are assumed not to throw when moved.
+template <typename Result, typename... Args, size_t InlineSize>
+class UniqueFunction<Result(Args...), InlineSize>
+{
+    template <typename Functor>
+    struct IsCallable
+    {
+        template <typename F>
+        static auto Test(int) -> decltype(std::declval<F&>()(std::declval<Args>()...), std::true_type());
+
+        template <typename F>
+        static std::false_type Test(...);
+
+        typedef typename std::decay<Functor>::type DecayedType;
+
+        static const bool value =
+            !std::is_same<DecayedType, UniqueFunction>::value && decltype(Test<DecayedType>(0))::value;
+    };
+
+public:
+    UniqueFunction() : _operations(nullptr) { }
+
+    UniqueFunction(std::nullptr_t) : _operations(nullptr) { }
+
+    template <typename Functor, typename = typename std::enable_if<IsCallable<Functor>::value>::type>
+    UniqueFunction(Functor&& functor) : _operations(nullptr)
+    {
+        typedef typename std::decay<Functor>::type FunctorType;
+
+        // Keep null function pointers and empty std::functions empty, like std::function does.
+        if (!IsNull(functor))
+        {
+            typedef typename std::conditional<
+                (sizeof(FunctorType) <= InlineSize && alignof(FunctorType) <= alignof(Storage)),
+                InlineOperations<FunctorType>,
+                HeapOperations<FunctorType>>::type Operations;
+
+            Operations::Construct(&_storage, std::forward<Functor>(functor));
+            _operations = Operations::Get();
+        }
+    }
+
+    UniqueFunction(UniqueFunction&& other) : _operations(nullptr)
+    {
+        MoveFrom(other);
+    }
+
+    UniqueFunction& operator=(UniqueFunction&& other)
+    {
+        if (this != &other)
+        {
+            Reset();
+            MoveFrom(other);
+        }
+        return *this;
+    }
+
+    UniqueFunction& operator=(std::nullptr_t)
+    {
+        Reset();
+        return *this;
+    }
+
+    ~UniqueFunction()
+    {
+        Reset();
+    }
+
+    Result operator()(Args... args)
+    {
+        if (_operations == nullptr)
+        {
+            throw std::bad_function_call();
+        }
+
+        return _operations->invoke(&_storage, std::forward<Args>(args)...);
+    }
+
+    explicit operator bool() const
+    {
+        return _operations != nullptr;
+    }
+
+    // Returns true if the callable is stored inline (or there is none), i.e. no heap allocation was made.
+    bool IsInline() const
+    {
+        return _operations == nullptr || _operations->isInline;
+    }
+
+    friend bool operator==(const UniqueFunction& function, std::nullptr_t) { return !function; }
+    friend bool operator==(std::nullptr_t, const UniqueFunction& function) { return !function; }
+    friend bool operator!=(const UniqueFunction& function, std::nullptr_t) { return !!function; }
+    friend bool operator!=(std::nullptr_t, const UniqueFunction& function) { return !!function; }
+
+private:
+    UniqueFunction(const UniqueFunction&) = delete;
+    UniqueFunction& operator=(const UniqueFunction&) = delete;
+
+    typedef typename std::aligned_storage<InlineSize>::type Storage;
+
+    // Type-erased operations on the stored callable, one static instance per callable type.
+    struct Operations
+    {
+        Result (*invoke)(void* storage, Args&&... args);
+        void (*move)(void* destination, void* source);
+        void (*destroy)(void* storage);
+        bool isInline;
+    };
+
+    template <typename FunctorType>
+    struct InlineOperations
+    {
+        template <typename Functor>
+        static void Construct(void* storage, Functor&& functor)
+        {
+            new (storage) FunctorType(std::forward<Functor>(functor));
+        }
+
+        static Result Invoke(void* storage, Args&&... args)
+        {
+            return (*static_cast<FunctorType*>(storage))(std::forward<Args>(args)...);
+        }
+
+        static void Move(void* destination, void* source)
+        {
+            new (destination) FunctorType(std::move(*static_cast<FunctorType*>(source)));
+            static_cast<FunctorType*>(source)->~FunctorType();
+        }
+
+        static void Destroy(void* storage)
+        {
+            static_cast<FunctorType*>(storage)->~FunctorType();
+        }
+
+        static const Operations* Get()
+        {
+            static const Operations operations = { &Invoke, &Move, &Destroy, true };
+            return &operations;
+        }
+    };
+
+    template <typename FunctorType>
+    struct HeapOperations
+    {
+        template <typename Functor>
+        static void Construct(void* storage, Functor&& functor)
+        {
+            *static_cast<FunctorType**>(storage) = new FunctorType(std::forward<Functor>(functor));
+        }
+
+        static Result Invoke(void* storage, Args&&... args)
+        {
+            return (**static_cast<FunctorType**>(storage))(std::forward<Args>(args)...);
+        }
+
+        static void Move(void* destination, void* source)
+        {
+            *static_cast<FunctorType**>(destination) = *static_cast<FunctorType**>(source);
+        }
+
+        static void Destroy(void* storage)
+        {
+            delete *static_cast<FunctorType**>(storage);
+        }
+
+        static const Operations* Get()
+        {
+            static const Operations operations = { &Invoke, &Move, &Destroy, false };
+            return &operations;
+        }
+    };
+
+    template <typename Functor>
+    static bool IsNull(const Functor&) { return false; }
+
+    template <typename FunctionResult, typename... FunctionArgs>
+    static bool IsNull(FunctionResult (* const& function)(FunctionArgs...)) { return function == nullptr; }
+
+    template <typename Signature>
+    static bool IsNull(const std::function<Signature>& function) { return !function; }
+
+    void MoveFrom(UniqueFunction& other)
+    {
+        if (other._operations != nullptr)
+        {
+            other._operations->move(&_storage, &other._storage);
+            _operations = other._operations;
+            other._operations = nullptr;
+        }
+    }
+
+    void Reset()
+    {
+        if (_operations != nullptr)
+        {
+            _operations->destroy(&_storage);
+            _operations = nullptr;
+        }
+    }
+
+    Storage _storage;
+    const Operations* _operations;
+};
+
+}
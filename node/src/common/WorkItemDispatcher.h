@@ -17,31 +17,280 @@
 namespace OpenT2T
 {
 
+// Selects what WorkItemDispatcher::Dispatch does with a work item dispatched from the
+// dispatcher's own worker thread, i.e. by another work item.
+enum class ReentrantDispatchMode
+{
+    // Queue it like any other work item.
+    Queue,
+
+    // Run it as soon as the dispatching work item returns, ahead of everything queued and
+    // without going through the queue. Continuations run in the order they were dispatched.
+    Continuation,
+
+    // Run it immediately, nested inside the dispatching work item, as a direct call would.
+    // Beyond ReentrantDispatchOptions::maxInlineDepth it becomes a continuation instead.
+    Inline,
+};
+
+// Options for work items dispatched from the dispatcher's worker thread. Such items skip the
+// queue's priority lanes, tenant scheduling, capacity and stats. To keep one chain of work
+// from monopolizing the worker, after maxContinuations continuations have run (or are waiting)
+// for one queued work item, further reentrant dispatches are queued normally.
+struct ReentrantDispatchOptions
+{
+    ReentrantDispatchOptions(ReentrantDispatchMode mode = ReentrantDispatchMode::Queue) :
+        mode(mode),
+        maxInlineDepth(8),
+        maxContinuations(64)
+    {
+    }
+
+    ReentrantDispatchMode mode;
+    size_t maxInlineDepth;
+    size_t maxContinuations;
+};
+
+// Handle to the completion of a single dispatched work item (see
+// WorkItemDispatcher::DispatchWithCompletion). Copies refer to the same work item.
+class WorkItemCompletion
+{
+public:
+    WorkItemCompletion() { }
+
+    // Returns false for a default-constructed handle, which is not tied to any work item.
+    bool IsValid() const
+    {
+        return _state != nullptr;
+    }
+
+    // Returns true once the work item has run, or has been dropped or rejected by the queue.
+    bool IsCompleted() const
+    {
+        std::lock_guard<std::mutex> lock(_state->mutex);
+        return _state->completed;
+    }
+
+    // Waits until the work item completes. Returns false if the timeout elapsed first.
+    // Throws std::logic_error if called from the dispatcher's worker thread before the item
+    // has run, since the item could never run while the worker is blocked waiting for it.
+    bool Wait(std::chrono::milliseconds timeout = std::chrono::milliseconds::max()) const
+    {
+        std::unique_lock<std::mutex> lock(_state->mutex);
+        if (_state->completed)
+        {
+            return true;
+        }
+
+        if (std::this_thread::get_id() == _state->workerThreadId)
+        {
+            throw std::logic_error("Cannot wait for a work item from the dispatcher's own thread.");
+        }
+
+        auto isCompleted = [this] { return _state->completed; };
+        if (timeout == std::chrono::milliseconds::max())
+        {
+            _state->completedCondition.wait(lock, isCompleted);
+            return true;
+        }
+
+        return _state->completedCondition.wait_for(lock, timeout, isCompleted);
+    }
+
+    // Gets the exception thrown by the work item, or one describing why it was dropped or
+    // rejected. Null if the item ran successfully or has not completed yet.
+    std::exception_ptr GetException() const
+    {
+        std::lock_guard<std::mutex> lock(_state->mutex);
+        return _state->exception;
+    }
+
+private:
+    friend class WorkItemDispatcher;
+
+    // Owns the work item's functor as well, so the queued item only holds a pointer to this
+    // state and a dispatch with completion costs a single allocation.
+    struct State
+    {
+        State(UniqueFunction<void()>&& functor, std::thread::id workerThreadId) :
+            functor(std::move(functor)),
+            workerThreadId(workerThreadId),
+            completed(false)
+        {
+        }
+
+        void Run()
+        {
+            try
+            {
+                if (functor)
+                {
+                    functor();
+                }
+            }
+            catch (...)
+            {
+                Complete(std::current_exception());
+                return;
+            }
+
+            Complete(nullptr);
+        }
+
+        void Complete(std::exception_ptr ex)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (completed)
+                {
+                    return;
+                }
+
+                // Release the functor's captures now rather than when the last handle goes away.
+                functor = nullptr;
+                exception = ex;
+                completed = true;
+            }
+
+            completedCondition.notify_all();
+        }
+
+        UniqueFunction<void()> functor;
+        const std::thread::id workerThreadId;
+        std::mutex mutex;
+        std::condition_variable completedCondition;
+        bool completed;
+        std::exception_ptr exception;
+    };
+
+    WorkItemCompletion(const std::shared_ptr<State>& state) : _state(state) { }
+
+    std::shared_ptr<State> _state;
+};
+
 class WorkItemDispatcher
 {
 public:
-    using WorkItemFunctorType = std::function<void()>;
+    // Move-only, so dispatching a typical closure does not allocate (see UniqueFunction).
+    using WorkItemFunctorType = UniqueFunction<void()>;
+
+    // Background work run on the worker thread between work items; see SetIdleFunctor.
+    using IdleFunctorType = std::function<std::chrono::steady_clock::duration()>;
+
+    // A work item plus an optional functor to invoke instead if the item is dropped, or if
+    // its cancellation token is cancelled before it starts.
+    struct WorkItem
+    {
+        WorkItem() { }
 
-    WorkItemDispatcher() { }
+        template <typename FunctorType, typename DroppedFunctorType>
+        WorkItem(FunctorType&& functor, DroppedFunctorType&& droppedFunctor) :
+            functor(std::forward<FunctorType>(functor)),
+            droppedFunctor(std::forward<DroppedFunctorType>(droppedFunctor))
+        {
+        }
+
+        template <typename FunctorType, typename DroppedFunctorType>
+        WorkItem(
+            FunctorType&& functor,
+            DroppedFunctorType&& droppedFunctor,
+            const CancellationToken& cancellationToken) :
+            functor(std::forward<FunctorType>(functor)),
+            droppedFunctor(std::forward<DroppedFunctorType>(droppedFunctor)),
+            cancellationToken(cancellationToken)
+        {
+        }
+
+        WorkItemFunctorType functor;
+        WorkItemFunctorType droppedFunctor;
+        CancellationToken cancellationToken;
+    };
 
-    bool Dispatch(const WorkItemFunctorType& workItemFunctor)
+    WorkItemDispatcher(
+        const AsyncQueueOptions& options = AsyncQueueOptions(),
+        const ReentrantDispatchOptions& reentrantOptions = ReentrantDispatchOptions()) :
+        _asyncQueue(options),
+        _reentrantOptions(reentrantOptions),
+        _inlineDepth(0),
+        _continuationCount(0)
     {
-        return workItemFunctor == nullptr || _asyncQueue.Push(workItemFunctor);
     }
 
-    bool Dispatch(WorkItemFunctorType&& workItemFunctor)
+    // Dispatches a work item to the specified priority lane (0 is highest; see
+    // AsyncQueueOptions::laneCount) on behalf of the specified tenant. Tenants in the same
+    // lane take turns, weighted by SetTenantWeight. A work item dispatched from the worker
+    // thread may instead run without being queued; see ReentrantDispatchOptions.
+    bool Dispatch(WorkItemFunctorType&& workItemFunctor, size_t lane = 0, size_t tenant = 0)
     {
-        return workItemFunctor == nullptr || _asyncQueue.Push(std::move(workItemFunctor));
+        return DispatchItem(WorkItem(std::move(workItemFunctor), nullptr), lane, tenant);
     }
 
-    bool DispatchAndWait(WorkItemFunctorType&& workItemFunctor)
+    // Dispatches a work item to a bounded queue. If the item is later discarded by the
+    // DropOldest overflow policy, droppedFunctor is invoked instead (on the dispatching
+    // thread that caused the overflow) so the caller can fail any pending callback.
+    bool Dispatch(
+        WorkItemFunctorType&& workItemFunctor,
+        WorkItemFunctorType&& droppedFunctor,
+        size_t lane = 0,
+        size_t tenant = 0)
     {
-        bool ret = workItemFunctor == nullptr || _asyncQueue.Push(std::move(workItemFunctor));
-        if (ret)
+        return DispatchItem(WorkItem(std::move(workItemFunctor), std::move(droppedFunctor)), lane, tenant);
+    }
+
+    // Dispatches a work item with a dropped functor and cancellation token. If the token is
+    // cancelled before the item starts, the item is skipped and its dropped functor is invoked
+    // instead, on the worker thread.
+    bool DispatchItem(WorkItem&& workItem, size_t lane = 0, size_t tenant = 0)
+    {
+        return workItem.functor == nullptr ||
+            TryDispatchReentrant(workItem) ||
+            _asyncQueue.Push(std::move(workItem), lane, tenant);
+    }
+
+    // Dispatches a sequence of work items in order with a single queue lock acquisition and
+    // worker wakeup. Returns the number of items dispatched; those are moved out of the front
+    // of the vector, and any after them (rejected by a full queue) are left untouched.
+    size_t DispatchBatch(std::vector<WorkItem>& workItems, size_t lane = 0, size_t tenant = 0)
+    {
+        return _asyncQueue.PushRange(workItems.begin(), workItems.end(), lane, tenant);
+    }
+
+    // Dispatches a work item that is exempt from the queue capacity and is never dropped.
+    bool DispatchUnbounded(WorkItemFunctorType&& workItemFunctor, size_t lane = 0)
+    {
+        return workItemFunctor == nullptr ||
+            _asyncQueue.PushUnbounded(WorkItem(std::move(workItemFunctor), nullptr), lane);
+    }
+
+    // Dispatches a work item and returns a handle that completes when that item has run.
+    // An item that is rejected or later dropped by a full queue completes with an exception
+    // rather than never completing.
+    WorkItemCompletion DispatchWithCompletion(WorkItemFunctorType&& workItemFunctor, size_t lane = 0)
+    {
+        bool dispatched;
+        return DispatchWithCompletion(std::move(workItemFunctor), lane, dispatched);
+    }
+
+    // Dispatches a work item and waits for that item (not the whole queue) to run. Returns false
+    // without dispatching when called from the worker thread, which would otherwise deadlock.
+    // An unbounded item is exempt from the queue capacity and is never dropped, as with
+    // DispatchUnbounded; it can still be discarded without running if the queue shuts down.
+    bool DispatchAndWait(WorkItemFunctorType&& workItemFunctor, size_t lane = 0, bool unbounded = false)
+    {
+        if (_asyncQueue.IsWorkerThread())
+        {
+            LogWarning("DispatchAndWait called from the dispatcher's own thread.");
+            return false;
+        }
+
+        bool dispatched;
+        WorkItemCompletion completion =
+            DispatchWithCompletion(std::move(workItemFunctor), lane, dispatched, unbounded);
+        if (dispatched)
         {
-            _asyncQueue.WaitForAll();
+            completion.Wait();
         }
-        return ret;
+        return dispatched;
     }
 
     void Shutdown()
@@ -49,27 +298,255 @@ public:
         _asyncQueue.Uninitialize();
     }
 
+    // Sets a functor that the worker thread runs whenever the queue runs out of work items, to
+    // interleave some other source of work with them (such as an event loop). It returns how
+    // long the worker may wait for work items before running it again, or duration::max() when
+    // it has nothing left to do until the next work item. Must be set before Initialize.
+    void SetIdleFunctor(IdleFunctorType idleFunctor)
+    {
+        _idleFunctor = std::move(idleFunctor);
+    }
+
+    // Asks the worker thread to run the idle functor before the next work item, instead of only
+    // once the queue runs out of them. Must be called from a work item.
+    void RequestIdle()
+    {
+        _asyncQueue.RequestIdle();
+    }
+
     void Initialize()
     {
-        auto queueItemHandler = std::make_shared<QueueItemHandler>();
+        auto queueItemHandler = std::make_shared<QueueItemHandler>(this);
 
         _asyncQueue.Initialize(queueItemHandler);
     }
 
+    // Gets the number of work items waiting to be processed.
+    size_t GetQueueDepth() const
+    {
+        return _asyncQueue.GetDepth();
+    }
+
+    // Gets the largest number of work items that have been waiting at once.
+    size_t GetQueueHighWaterMark() const
+    {
+        return _asyncQueue.GetHighWaterMark();
+    }
+
+    // Gets a snapshot of queue depth, throughput, wait and execution times, and exceptions.
+    AsyncQueueStats GetQueueStats() const
+    {
+        return _asyncQueue.GetStats();
+    }
+
+    void ResetQueueStats()
+    {
+        _asyncQueue.ResetStats();
+    }
+
+    // See AsyncQueue::SetTenantWeight.
+    void SetTenantWeight(size_t tenant, unsigned int weight)
+    {
+        _asyncQueue.SetTenantWeight(tenant, weight);
+    }
+
+    // Gets per-tenant depth, counts and wait times.
+    std::vector<AsyncQueueTenantStats> GetTenantStats() const
+    {
+        return _asyncQueue.GetTenantStats();
+    }
+
+    // Returns true if called from the dispatcher's worker thread, i.e. from within a work item.
+    bool IsDispatcherThread() const
+    {
+        return _asyncQueue.IsWorkerThread();
+    }
+
 private:
+    // Runs or defers a work item dispatched from the worker thread, as the reentrant dispatch
+    // options allow. Returns false (leaving the item alone) if it should be queued instead.
+    bool TryDispatchReentrant(WorkItem& workItem)
+    {
+        if (_reentrantOptions.mode == ReentrantDispatchMode::Queue || !IsDispatcherThread())
+        {
+            return false;
+        }
+
+        if (_reentrantOptions.mode == ReentrantDispatchMode::Inline &&
+            _inlineDepth < _reentrantOptions.maxInlineDepth)
+        {
+            _inlineDepth++;
+            RunReentrant(workItem);
+            _inlineDepth--;
+            return true;
+        }
+
+        if (_continuationCount + _continuations.Size() < _reentrantOptions.maxContinuations)
+        {
+            _continuations.Push(std::move(workItem));
+            return true;
+        }
 
-    class QueueItemHandler final : public IQueueItemHandler<WorkItemFunctorType>
+        return false;
+    }
+
+    // Runs the continuations dispatched by a queued work item (and by those continuations).
+    // Called on the worker thread after each queued work item.
+    void RunContinuations()
+    {
+        while (!_continuations.IsEmpty())
+        {
+            WorkItem continuation = std::move(_continuations.Front());
+            _continuations.Pop();
+            _continuationCount++;
+            RunReentrant(continuation);
+        }
+
+        _continuationCount = 0;
+    }
+
+    // Runs a work item that bypassed the queue. Exceptions are logged and swallowed, as the
+    // queue does, rather than thrown into the work item that dispatched it.
+    static void RunReentrant(WorkItem& workItem)
+    {
+        try
+        {
+            RunWorkItem(workItem);
+        }
+        catch (...)
+        {
+            LogWarning("Caught exception while running reentrant work item.");
+        }
+    }
+
+    // Runs a work item, or its dropped functor if it has been cancelled.
+    static void RunWorkItem(WorkItem& workItem)
+    {
+        if (workItem.cancellationToken.IsCancelled())
+        {
+            if (workItem.droppedFunctor)
+            {
+                workItem.droppedFunctor();
+            }
+        }
+        else if (workItem.functor)
+        {
+            workItem.functor();
+        }
+    }
+
+    WorkItemCompletion DispatchWithCompletion(
+        WorkItemFunctorType&& workItemFunctor,
+        size_t lane,
+        bool& dispatched,
+        bool unbounded = false)
+    {
+        auto state = std::make_shared<WorkItemCompletion::State>(
+            std::move(workItemFunctor), _asyncQueue.GetWorkerThreadId());
+
+        WorkItem workItem(
+            CompletionWorkItem(state),
+            [state]()
+            {
+                state->Complete(std::make_exception_ptr(
+                    std::runtime_error("Work item was dropped because the queue is full.")));
+            });
+        dispatched = (unbounded ?
+            _asyncQueue.PushUnbounded(std::move(workItem), lane) :
+            _asyncQueue.Push(std::move(workItem), lane));
+
+        if (!dispatched)
+        {
+            state->Complete(std::make_exception_ptr(std::runtime_error("Work item was not queued.")));
+        }
+
+        return WorkItemCompletion(state);
+    }
+
+    // Runs a work item dispatched with completion. If the queue discards the item without
+    // running it (e.g. on shutdown), the completion is signaled with an exception instead.
+    class CompletionWorkItem
+    {
+    public:
+        CompletionWorkItem(const std::shared_ptr<WorkItemCompletion::State>& state) : _state(state) { }
+        CompletionWorkItem(CompletionWorkItem&& other) : _state(std::move(other._state)) { }
+
+        ~CompletionWorkItem()
+        {
+            if (_state != nullptr)
+            {
+                _state->Complete(std::make_exception_ptr(std::runtime_error("Work item was discarded.")));
+            }
+        }
+
+        void operator()()
+        {
+            _state->Run();
+        }
+
+    private:
+        std::shared_ptr<WorkItemCompletion::State> _state;
+    };
+
+    class QueueItemHandler final : public IQueueItemHandler<WorkItem>
     {
     public:
-        QueueItemHandler() {}
+        QueueItemHandler(WorkItemDispatcher* dispatcher) : _dispatcher(dispatcher) {}
         ~QueueItemHandler() {}
 
         void OnStarted() override {}
-        void OnProcessQueueItem(WorkItemFunctorType& workItemFunctor) override { workItemFunctor(); }
+        void OnDropQueueItem(WorkItem& workItem) override { if (workItem.droppedFunctor) workItem.droppedFunctor(); }
         void OnStopped() override {}
+
+        std::chrono::steady_clock::duration OnIdle() override
+        {
+            if (!_dispatcher->_idleFunctor)
+            {
+                return std::chrono::steady_clock::duration::max();
+            }
+
+            std::chrono::steady_clock::duration pollInterval;
+            try
+            {
+                pollInterval = _dispatcher->_idleFunctor();
+            }
+            catch (...)
+            {
+                _dispatcher->RunContinuations();
+                throw;
+            }
+
+            _dispatcher->RunContinuations();
+            return pollInterval;
+        }
+
+        void OnProcessQueueItem(WorkItem& workItem) override
+        {
+            try
+            {
+                RunWorkItem(workItem);
+            }
+            catch (...)
+            {
+                _dispatcher->RunContinuations();
+                throw;
+            }
+
+            _dispatcher->RunContinuations();
+        }
+
+    private:
+        WorkItemDispatcher* _dispatcher;
     };
 
-    AsyncQueue<WorkItemFunctorType> _asyncQueue;
+    AsyncQueue<WorkItem> _asyncQueue;
+    const ReentrantDispatchOptions _reentrantOptions;
+    IdleFunctorType _idleFunctor;
+
+    // Reentrant dispatch state, only used on the worker thread.
+    size_t _inlineDepth;
+    size_t _continuationCount;
+    RingQueue<WorkItem> _continuations;
 };
 
 }
@@ -1,19 +1,42 @@
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <deque>
 #include <exception>
 #include <functional>
+#include <iterator>
+#include <list>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <new>
 #include <queue>
 #include <stdexcept>
 #include <string>
 #include <thread>
+#include <type_traits>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "Log.h"
+#include "CancellationToken.h"
+#include "ThreadOptions.h"
+#include "MpscQueue.h"
+#include "RingQueue.h"
+#include "FairQueue.h"
 #include "AsyncQueue.h"
+#include "UniqueFunction.h"
 #include "WorkItemDispatcher.h"
+#include "NodeValue.h"
 #include "INodeEngine.h"
+#include "ThreadPool.h"
+#include "LruCache.h"
+#include "SlotTable.h"
 #include "JXCoreEngine.h"
 
 #import "OT2TNodeEngine.h"
@@ -1,10 +1,20 @@
 ﻿#include "pch.h"
 #include "Log.h"
+#include "CancellationToken.h"
 #include "WinrtUtils.h"
+#include "NodeValue.h"
 #include "INodeEngine.h"
 #include "NodeEngine.h"
+#include "ThreadOptions.h"
+#include "MpscQueue.h"
+#include "RingQueue.h"
+#include "FairQueue.h"
 #include "AsyncQueue.h"
+#include "UniqueFunction.h"
 #include "WorkItemDispatcher.h"
+#include "ThreadPool.h"
+#include "LruCache.h"
+#include "SlotTable.h"
 #include "JXCoreEngine.h"
 
 using namespace Platform;
@@ -1,9 +1,23 @@
 ﻿#pragma once
 
 #include <cvt/wstring>
+#include <atomic>
+#include <chrono>
 #include <codecvt>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iterator>
+#include <list>
+#include <map>
+#include <new>
 #include <queue>
+#include <stdexcept>
+#include <type_traits>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include <collection.h>
 #include <ppltasks.h>
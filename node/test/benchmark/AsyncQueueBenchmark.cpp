@@ -0,0 +1,226 @@
+// Compares producer throughput and push latency of the AsyncQueue backends (FairQueue
+// lanes of RingQueues under a mutex vs. lock-free MPSC inbox) at 1 to 64 producer threads,
+// and the cost of enqueueing bursts item by item vs. with PushRange.
+//
+// Build and run on Linux from this directory:
+//   g++ -std=c++11 -O2 -I ../../src/common -o AsyncQueueBenchmark -pthread
+//       AsyncQueueBenchmark.cpp ../../src/common/Log.cpp ../../src/common/ThreadOptions.cpp
+//   ./AsyncQueueBenchmark [totalItems]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "Log.h"
+#include "ThreadOptions.h"
+#include "MpscQueue.h"
+#include "RingQueue.h"
+#include "FairQueue.h"
+#include "AsyncQueue.h"
+
+using namespace OpenT2T;
+
+typedef std::chrono::steady_clock Clock;
+
+class CountingHandler : public IQueueItemHandler<uint64_t>
+{
+public:
+    CountingHandler() : processed(0) { }
+
+    void OnStarted() override { }
+    void OnProcessQueueItem(uint64_t&) override { processed.fetch_add(1, std::memory_order_relaxed); }
+    void OnStopped() override { }
+
+    std::atomic<uint64_t> processed;
+};
+
+struct RunResult
+{
+    double pushesPerSecond;
+    double drainSeconds;
+    std::vector<uint64_t> latencies;
+};
+
+RunResult Run(AsyncQueueBackend backend, int producerCount, uint64_t totalItems)
+{
+    auto handler = std::make_shared<CountingHandler>();
+    AsyncQueue<uint64_t> queue(backend);
+    queue.Initialize(handler);
+
+    uint64_t itemsPerProducer = totalItems / producerCount;
+    std::vector<std::vector<uint64_t>> latencies(producerCount);
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < producerCount; p++)
+    {
+        producers.emplace_back([&, p]()
+        {
+            std::vector<uint64_t>& samples = latencies[p];
+            samples.reserve(itemsPerProducer);
+
+            ready.fetch_add(1);
+            while (!go.load()) std::this_thread::yield();
+
+            for (uint64_t i = 0; i < itemsPerProducer; i++)
+            {
+                Clock::time_point before = Clock::now();
+                queue.Push(i);
+                Clock::time_point after = Clock::now();
+                samples.push_back(static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count()));
+            }
+        });
+    }
+
+    while (ready.load() != producerCount) std::this_thread::yield();
+
+    Clock::time_point start = Clock::now();
+    go.store(true);
+    for (std::thread& producer : producers)
+    {
+        producer.join();
+    }
+    Clock::time_point pushed = Clock::now();
+
+    uint64_t expected = itemsPerProducer * producerCount;
+    while (handler->processed.load() != expected) std::this_thread::yield();
+    Clock::time_point drained = Clock::now();
+
+    queue.Uninitialize();
+
+    RunResult result;
+    result.pushesPerSecond = expected / std::chrono::duration<double>(pushed - start).count();
+    result.drainSeconds = std::chrono::duration<double>(drained - pushed).count();
+    for (const std::vector<uint64_t>& samples : latencies)
+    {
+        result.latencies.insert(result.latencies.end(), samples.begin(), samples.end());
+    }
+    std::sort(result.latencies.begin(), result.latencies.end());
+    return result;
+}
+
+// Pushes bursts of burstSize items from 4 producers, either one Push per item or one PushRange
+// per burst. Returns producer throughput in items per second.
+double RunBursts(AsyncQueueBackend backend, bool batched, size_t burstSize, uint64_t totalItems)
+{
+    const int producerCount = 4;
+    auto handler = std::make_shared<CountingHandler>();
+    AsyncQueue<uint64_t> queue(backend);
+    queue.Initialize(handler);
+
+    uint64_t burstsPerProducer = totalItems / producerCount / burstSize;
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < producerCount; p++)
+    {
+        producers.emplace_back([&]()
+        {
+            std::vector<uint64_t> burst(burstSize);
+
+            ready.fetch_add(1);
+            while (!go.load()) std::this_thread::yield();
+
+            for (uint64_t b = 0; b < burstsPerProducer; b++)
+            {
+                if (batched)
+                {
+                    queue.PushRange(burst.begin(), burst.end());
+                }
+                else
+                {
+                    for (uint64_t item : burst)
+                    {
+                        queue.Push(item);
+                    }
+                }
+            }
+        });
+    }
+
+    while (ready.load() != producerCount) std::this_thread::yield();
+
+    Clock::time_point start = Clock::now();
+    go.store(true);
+    for (std::thread& producer : producers)
+    {
+        producer.join();
+    }
+    Clock::time_point pushed = Clock::now();
+
+    uint64_t expected = burstsPerProducer * burstSize * producerCount;
+    while (handler->processed.load() != expected) std::this_thread::yield();
+    queue.Uninitialize();
+
+    return expected / std::chrono::duration<double>(pushed - start).count();
+}
+
+uint64_t Percentile(const std::vector<uint64_t>& sorted, double percentile)
+{
+    size_t index = static_cast<size_t>(percentile / 100.0 * (sorted.size() - 1));
+    return sorted[index];
+}
+
+int main(int argc, char** argv)
+{
+    uint64_t totalItems = (argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000);
+
+    std::printf("%-9s %9s %12s %10s %10s %10s %10s %10s\n",
+        "backend", "producers", "Mpush/s", "drain ms", "p50 ns", "p99 ns", "p99.9 ns", "max ns");
+
+    const int producerCounts[] = { 1, 2, 4, 8, 16, 32, 64 };
+    for (int producerCount : producerCounts)
+    {
+        const AsyncQueueBackend backends[] = { AsyncQueueBackend::Locked, AsyncQueueBackend::LockFree };
+        for (AsyncQueueBackend backend : backends)
+        {
+            RunResult result = Run(backend, producerCount, totalItems);
+            std::printf("%-9s %9d %12.2f %10.1f %10llu %10llu %10llu %10llu\n",
+                (backend == AsyncQueueBackend::Locked ? "locked" : "lockfree"),
+                producerCount,
+                result.pushesPerSecond / 1e6,
+                result.drainSeconds * 1e3,
+                static_cast<unsigned long long>(Percentile(result.latencies, 50)),
+                static_cast<unsigned long long>(Percentile(result.latencies, 99)),
+                static_cast<unsigned long long>(Percentile(result.latencies, 99.9)),
+                static_cast<unsigned long long>(result.latencies.back()));
+        }
+    }
+
+    std::printf("\n%-9s %6s %14s %14s\n", "backend", "burst", "Push Mitem/s", "Range Mitem/s");
+
+    const size_t burstSizes[] = { 8, 64, 512 };
+    for (size_t burstSize : burstSizes)
+    {
+        const AsyncQueueBackend backends[] = { AsyncQueueBackend::Locked, AsyncQueueBackend::LockFree };
+        for (AsyncQueueBackend backend : backends)
+        {
+            std::printf("%-9s %6u %14.2f %14.2f\n",
+                (backend == AsyncQueueBackend::Locked ? "locked" : "lockfree"),
+                static_cast<unsigned int>(burstSize),
+                RunBursts(backend, false, burstSize, totalItems) / 1e6,
+                RunBursts(backend, true, burstSize, totalItems) / 1e6);
+        }
+    }
+
+    return 0;
+}
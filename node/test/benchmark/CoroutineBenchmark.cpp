@@ -0,0 +1,165 @@
+// Measures the cost of the coroutine helpers in NodeEngineTask.h: awaiting a Task that
+// completes synchronously, and a coroutine hopping back and forth between a ThreadPool thread
+// and a WorkItemDispatcher thread with ResumeOn, compared with the same hops made by callbacks
+// that submit each other. It also serves as a usage sample, since the helpers need C++20.
+//
+// Build and run on Linux from this directory:
+//   g++ -std=c++20 -O2 -I ../../src/common -o CoroutineBenchmark -pthread
+//       CoroutineBenchmark.cpp ../../src/common/Log.cpp ../../src/common/ThreadOptions.cpp
+//   ./CoroutineBenchmark [awaits] [roundTrips]
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "Log.h"
+#include "CancellationToken.h"
+#include "NodeValue.h"
+#include "INodeEngine.h"
+#include "ThreadOptions.h"
+#include "MpscQueue.h"
+#include "RingQueue.h"
+#include "FairQueue.h"
+#include "AsyncQueue.h"
+#include "UniqueFunction.h"
+#include "WorkItemDispatcher.h"
+#include "ThreadPool.h"
+#include "NodeEngineTask.h"
+
+using namespace OpenT2T;
+
+typedef std::chrono::steady_clock Clock;
+
+// Signals the waiting thread when a started task finishes.
+class CompletionEvent
+{
+public:
+    CompletionEvent() : _completed(false) { }
+
+    void Set()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _completed = true;
+        _completedChanged.notify_one();
+    }
+
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _completedChanged.wait(lock, [this] { return _completed; });
+    }
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _completedChanged;
+    bool _completed;
+};
+
+double NanosecondsPer(Clock::duration elapsed, uint64_t count)
+{
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / count;
+}
+
+Task<uint64_t> GetValue(uint64_t value)
+{
+    co_return value;
+}
+
+Task<void> AwaitValues(uint64_t awaitCount, uint64_t& sum)
+{
+    for (uint64_t i = 0; i < awaitCount; i++)
+    {
+        sum += co_await GetValue(i);
+    }
+}
+
+Task<void> HopBetween(ThreadPool& threadPool, WorkItemDispatcher& dispatcher, uint64_t roundTrips, CompletionEvent& done)
+{
+    for (uint64_t i = 0; i < roundTrips; i++)
+    {
+        co_await ResumeOn(threadPool);
+        co_await ResumeOn(dispatcher);
+    }
+    done.Set();
+}
+
+// The same hops as HopBetween, made by callbacks that submit each other.
+void CallbackHop(ThreadPool& threadPool, WorkItemDispatcher& dispatcher, uint64_t remaining, CompletionEvent& done)
+{
+    if (remaining == 0)
+    {
+        done.Set();
+        return;
+    }
+
+    threadPool.Submit([&threadPool, &dispatcher, remaining, &done]()
+    {
+        dispatcher.Dispatch([&threadPool, &dispatcher, remaining, &done]()
+        {
+            CallbackHop(threadPool, dispatcher, remaining - 1, done);
+        });
+    });
+}
+
+int main(int argc, char** argv)
+{
+    uint64_t awaitCount = (argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000);
+    uint64_t roundTrips = (argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 100000);
+
+    logLevel = LogSeverity::Warning;
+
+    uint64_t sum = 0;
+    Clock::time_point start = Clock::now();
+    AwaitValues(awaitCount, sum).Start();
+    double nanosecondsPerAwait = NanosecondsPer(Clock::now() - start, awaitCount);
+
+    ThreadPool threadPool(1);
+    WorkItemDispatcher dispatcher;
+    dispatcher.Initialize();
+
+    CompletionEvent coroutineDone;
+    start = Clock::now();
+    HopBetween(threadPool, dispatcher, roundTrips, coroutineDone).Start();
+    coroutineDone.Wait();
+    double nanosecondsPerCoroutineRoundTrip = NanosecondsPer(Clock::now() - start, roundTrips);
+
+    CompletionEvent callbackDone;
+    start = Clock::now();
+    CallbackHop(threadPool, dispatcher, roundTrips, callbackDone);
+    callbackDone.Wait();
+    double nanosecondsPerCallbackRoundTrip = NanosecondsPer(Clock::now() - start, roundTrips);
+
+    dispatcher.Shutdown();
+    threadPool.Shutdown();
+
+    std::printf("%llu awaits (sum %llu), %llu round trips\n", static_cast<unsigned long long>(awaitCount),
+        static_cast<unsigned long long>(sum), static_cast<unsigned long long>(roundTrips));
+    std::printf("%-28s %12s\n", "", "ns each");
+    std::printf("%-28s %12.1f\n", "await completed task", nanosecondsPerAwait);
+    std::printf("%-28s %12.0f\n", "coroutine round trip", nanosecondsPerCoroutineRoundTrip);
+    std::printf("%-28s %12.0f\n", "callback round trip", nanosecondsPerCallbackRoundTrip);
+
+    return 0;
+}
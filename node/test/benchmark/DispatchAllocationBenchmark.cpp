@@ -0,0 +1,231 @@
+// Counts heap allocations per dispatch for closures shaped like JXCoreEngine::CallScript's
+// (engine pointer + script code string + result callback), comparing the previous
+// std::function + std::queue work item path with the current WorkItemDispatcher.
+//
+// Build and run on Linux from this directory:
+//   g++ -std=c++11 -O2 -I ../../src/common -o DispatchAllocationBenchmark -pthread
+//       DispatchAllocationBenchmark.cpp ../../src/common/Log.cpp ../../src/common/ThreadOptions.cpp
+//   ./DispatchAllocationBenchmark [dispatchCount]
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "Log.h"
+#include "CancellationToken.h"
+#include "ThreadOptions.h"
+#include "MpscQueue.h"
+#include "RingQueue.h"
+#include "FairQueue.h"
+#include "AsyncQueue.h"
+#include "UniqueFunction.h"
+#include "WorkItemDispatcher.h"
+
+using namespace OpenT2T;
+
+static std::atomic<uint64_t> s_allocationCount(0);
+
+// Counts every allocation through the global operator new. All the replaceable forms are
+// replaced, so that each allocation is freed by the matching form.
+void* CountedAllocate(size_t size)
+{
+    s_allocationCount.fetch_add(1, std::memory_order_relaxed);
+    void* p = std::malloc(size != 0 ? size : 1);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new(size_t size)
+{
+    return CountedAllocate(size);
+}
+
+void* operator new[](size_t size)
+{
+    return CountedAllocate(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+#if __cplusplus >= 201402L
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    std::free(p);
+}
+#endif
+
+typedef std::chrono::steady_clock Clock;
+typedef std::function<void(std::string resultJson, std::exception_ptr ex)> CallScriptCallback;
+
+// Stand-in for JXCoreEngine: same closure captures, but the "engine" only invokes the callback.
+class FakeEngine
+{
+public:
+    FakeEngine(AsyncQueueBackend backend) : _dispatcher(backend)
+    {
+        _dispatcher.Initialize();
+    }
+
+    ~FakeEngine()
+    {
+        _dispatcher.Shutdown();
+    }
+
+    // The work item path before UniqueFunction: lambda captures are copied into a std::function.
+    void CallScriptPrevious(std::string scriptCode, CallScriptCallback callback)
+    {
+        std::function<void()> workItem = [this, scriptCode, callback]()
+        {
+            this->CallScriptInternal(scriptCode, callback);
+        };
+
+        std::lock_guard<std::mutex> lock(_previousMutex);
+        _previousQueue.push(std::move(workItem));
+    }
+
+    void DrainPrevious()
+    {
+        std::lock_guard<std::mutex> lock(_previousMutex);
+        while (!_previousQueue.empty())
+        {
+            _previousQueue.front()();
+            _previousQueue.pop();
+        }
+    }
+
+    // The current path, as in JXCoreEngine::CallScript.
+    void CallScript(std::string scriptCode, CallScriptCallback callback)
+    {
+        WorkItemDispatcher::WorkItemFunctorType droppedFunctor = [callback]()
+        {
+            callback(std::string(), nullptr);
+        };
+
+        _dispatcher.Dispatch(
+            std::bind(&FakeEngine::CallScriptInternal, this, std::move(scriptCode), std::move(callback)),
+            std::move(droppedFunctor));
+    }
+
+    void WaitForAll()
+    {
+        _dispatcher.DispatchAndWait([]() { });
+    }
+
+private:
+    void CallScriptInternal(const std::string& /*scriptCode*/, const CallScriptCallback& callback)
+    {
+        callback(std::string(), nullptr);
+    }
+
+    WorkItemDispatcher _dispatcher;
+    std::mutex _previousMutex;
+    std::queue<std::function<void()>> _previousQueue;
+};
+
+std::vector<std::string> MakeScripts(size_t count)
+{
+    std::vector<std::string> scripts(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        scripts[i] = "require('opent2t-translator-com-example-device').getState(" + std::to_string(i) + ");";
+    }
+    return scripts;
+}
+
+void Report(const char* name, uint64_t allocations, Clock::duration elapsed, size_t dispatchCount)
+{
+    std::printf("%-22s %14.3f %14.1f\n",
+        name,
+        static_cast<double>(allocations) / dispatchCount,
+        std::chrono::duration<double, std::nano>(elapsed).count() / dispatchCount);
+}
+
+int main(int argc, char** argv)
+{
+    size_t dispatchCount = (argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000);
+
+    // Mimics a platform binding's callback, which captures a single handle (e.g. a promise).
+    void* promise = &dispatchCount;
+    std::atomic<size_t> completed(0);
+    auto makeCallback = [&completed, promise]()
+    {
+        return CallScriptCallback([&completed, promise](std::string, std::exception_ptr)
+        {
+            completed.fetch_add(1, std::memory_order_relaxed);
+        });
+    };
+
+    std::printf("%-22s %14s %14s\n", "path", "allocs/call", "ns/call");
+
+    {
+        FakeEngine engine(AsyncQueueBackend::Locked);
+        std::vector<std::string> scripts = MakeScripts(dispatchCount);
+
+        uint64_t before = s_allocationCount.load();
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < dispatchCount; i++)
+        {
+            engine.CallScriptPrevious(std::move(scripts[i]), makeCallback());
+        }
+        engine.DrainPrevious();
+        Report("previous std::function", s_allocationCount.load() - before, Clock::now() - start, dispatchCount);
+    }
+
+    const AsyncQueueBackend backends[] = { AsyncQueueBackend::Locked, AsyncQueueBackend::LockFree };
+    for (AsyncQueueBackend backend : backends)
+    {
+        FakeEngine engine(backend);
+
+        // Warm up so the queue's ring buffer has reached its working size.
+        std::vector<std::string> scripts = MakeScripts(dispatchCount);
+        for (size_t i = 0; i < 1000; i++)
+        {
+            engine.CallScript(scripts[i], makeCallback());
+        }
+        engine.WaitForAll();
+
+        uint64_t before = s_allocationCount.load();
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < dispatchCount; i++)
+        {
+            engine.CallScript(std::move(scripts[i]), makeCallback());
+        }
+        engine.WaitForAll();
+        Report(backend == AsyncQueueBackend::Locked ? "dispatcher (locked)" : "dispatcher (lock-free)",
+            s_allocationCount.load() - before, Clock::now() - start, dispatchCount);
+    }
+
+    return 0;
+}
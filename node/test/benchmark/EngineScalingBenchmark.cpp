@@ -0,0 +1,193 @@
+// Measures script call throughput of a JXCoreEnginePool as the number of engines doing the
+// work grows from 1 to N, with CPU-bound script calls submitted as fast as the pool takes them.
+// JXCore cannot create engine instances again once its first one has been destroyed, so a
+// single pool of N engines is started, and each run confines its calls to the first n engines
+// with affinity keys. A last run uses least-loaded routing over all N engines.
+//
+// Build and run on Linux from this directory, against a JXCore build:
+//   g++ -std=c++11 -O2 -I ../../src/common -I ../../src/external -o EngineScalingBenchmark -pthread
+//       EngineScalingBenchmark.cpp ../../src/common/Log.cpp ../../src/common/ThreadOptions.cpp
+//       ../../src/common/ScriptBundle.cpp ../../src/common/JXCoreEngine.cpp ../../src/common/JXCoreEnginePool.cpp
+//       -L <jxcore>/out -ljx
+//   ./EngineScalingBenchmark [engineCount] [callsPerRun] [loopIterations]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "Log.h"
+#include "CancellationToken.h"
+#include "NodeValue.h"
+#include "INodeEngine.h"
+#include "ThreadOptions.h"
+#include "MpscQueue.h"
+#include "RingQueue.h"
+#include "FairQueue.h"
+#include "AsyncQueue.h"
+#include "UniqueFunction.h"
+#include "WorkItemDispatcher.h"
+#include "ThreadPool.h"
+#include "LruCache.h"
+#include "SlotTable.h"
+#include "JXCoreEngine.h"
+#include "JXCoreEnginePool.h"
+
+using namespace OpenT2T;
+
+typedef std::chrono::steady_clock Clock;
+
+// Counts down completed calls, and wakes the waiting thread when all have completed.
+class CompletionCounter
+{
+public:
+    explicit CompletionCounter(size_t count) : _remainingCount(count), _failedCount(0) { }
+
+    void Complete(std::exception_ptr ex)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (ex != nullptr)
+        {
+            _failedCount++;
+        }
+
+        if (--_remainingCount == 0)
+        {
+            _completed.notify_one();
+        }
+    }
+
+    size_t Wait()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _completed.wait(lock, [this] { return _remainingCount == 0; });
+        return _failedCount;
+    }
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _completed;
+    size_t _remainingCount;
+    size_t _failedCount;
+};
+
+void WaitForEngine(const std::function<void(std::function<void(std::exception_ptr ex)>)>& startOrStop)
+{
+    CompletionCounter counter(1);
+    startOrStop([&counter](std::exception_ptr ex) { counter.Complete(ex); });
+    if (counter.Wait() != 0)
+    {
+        std::printf("Failed to start or stop the engine pool.\n");
+        std::exit(1);
+    }
+}
+
+// Runs the calls and returns calls per second. If engineCount is 0 the calls have no affinity
+// key; otherwise the keys spread them evenly over the first engineCount engines.
+double Run(JXCoreEnginePool& pool, size_t engineCount, size_t callCount, const std::string& scriptCode)
+{
+    CompletionCounter counter(callCount);
+    std::function<void(std::string, std::exception_ptr)> callback =
+        [&counter](std::string, std::exception_ptr ex) { counter.Complete(ex); };
+
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < callCount; i++)
+    {
+        CallScriptOptions options;
+        if (engineCount != 0)
+        {
+            // Key 0 means no affinity; the pool's engine count maps to engine 0 instead.
+            size_t engineIndex = i % engineCount;
+            options.affinityKey = (engineIndex != 0 ? engineIndex : pool.GetEngineCount());
+        }
+
+        pool.CallScript(scriptCode, options, callback);
+    }
+
+    size_t failedCount = counter.Wait();
+    Clock::duration elapsed = Clock::now() - start;
+
+    if (failedCount != 0)
+    {
+        std::printf("  %u calls failed\n", static_cast<unsigned int>(failedCount));
+    }
+
+    return callCount / std::chrono::duration_cast<std::chrono::duration<double>>(elapsed).count();
+}
+
+int main(int argc, char** argv)
+{
+    size_t engineCount = (argc > 1 ? std::strtoul(argv[1], nullptr, 10) :
+        std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), JXCoreEnginePool::MaxEngineCount));
+    size_t callCount = (argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 4000);
+    unsigned long loopIterations = (argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 100000);
+
+    logLevel = LogSeverity::Warning;
+
+    char scriptCode[128];
+    std::snprintf(scriptCode, sizeof(scriptCode),
+        "(function () { var x = 0; for (var i = 0; i < %lu; i++) { x += i; } return x; })()", loopIterations);
+
+    JXCoreEnginePool pool(engineCount);
+    WaitForEngine([&pool](std::function<void(std::exception_ptr ex)> callback)
+    {
+        pool.Start(".", std::move(callback));
+    });
+
+    // Warm up every engine's JIT before measuring.
+    Run(pool, engineCount, engineCount * 10, scriptCode);
+
+    std::printf("%u engines, %u calls per run, %lu loop iterations per call, %u hardware threads\n",
+        static_cast<unsigned int>(engineCount), static_cast<unsigned int>(callCount), loopIterations,
+        std::thread::hardware_concurrency());
+    std::printf("%-14s %14s %10s\n", "engines", "calls/s", "speedup");
+
+    std::vector<size_t> runEngineCounts;
+    for (size_t n = 1; n < engineCount; n *= 2)
+    {
+        runEngineCounts.push_back(n);
+    }
+    runEngineCounts.push_back(engineCount);
+
+    double baseline = 0;
+    for (size_t n : runEngineCounts)
+    {
+        double callsPerSecond = Run(pool, n, callCount, scriptCode);
+        if (n == 1)
+        {
+            baseline = callsPerSecond;
+        }
+
+        std::printf("%-14u %14.0f %9.2fx\n", static_cast<unsigned int>(n), callsPerSecond, callsPerSecond / baseline);
+    }
+
+    double callsPerSecond = Run(pool, 0, callCount, scriptCode);
+    std::printf("%-14s %14.0f %9.2fx\n", "least-loaded", callsPerSecond, callsPerSecond / baseline);
+
+    WaitForEngine([&pool](std::function<void(std::exception_ptr ex)> callback)
+    {
+        pool.Stop(std::move(callback));
+    });
+
+    return 0;
+}
@@ -0,0 +1,138 @@
+// Measures round-trip latency between two AsyncQueues that pass a token back and forth, so
+// every item arrives at an empty queue whose worker has to be woken. Compares the Block and
+// SpinThenPark wait strategies on both backends. Spinning only pays off when the two workers
+// can run on different cores.
+//
+// Build and run on Linux from this directory:
+//   g++ -std=c++11 -O2 -I ../../src/common -o PingPongBenchmark -pthread
+//       PingPongBenchmark.cpp ../../src/common/Log.cpp ../../src/common/ThreadOptions.cpp
+//   ./PingPongBenchmark [roundTrips]
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "Log.h"
+#include "ThreadOptions.h"
+#include "MpscQueue.h"
+#include "RingQueue.h"
+#include "FairQueue.h"
+#include "AsyncQueue.h"
+
+using namespace OpenT2T;
+
+typedef std::chrono::steady_clock Clock;
+
+// Passes each token on to the peer queue with its count decremented, until it reaches zero.
+class PingPongHandler : public IQueueItemHandler<uint64_t>
+{
+public:
+    PingPongHandler() : peer(nullptr), finished(false) { }
+
+    void OnStarted() override { }
+    void OnStopped() override { }
+
+    void OnProcessQueueItem(uint64_t& remaining) override
+    {
+        if (remaining == 0)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = true;
+            done.notify_one();
+        }
+        else
+        {
+            peer->Push(remaining - 1);
+        }
+    }
+
+    AsyncQueue<uint64_t>* peer;
+    std::mutex mutex;
+    std::condition_variable done;
+    bool finished;
+};
+
+struct RunResult
+{
+    double nanosecondsPerRoundTrip;
+    uint64_t spinWakeCount;
+    uint64_t parkCount;
+};
+
+RunResult Run(AsyncQueueBackend backend, AsyncQueueWaitStrategy waitStrategy, uint64_t roundTrips)
+{
+    AsyncQueueOptions options(backend);
+    options.waitStrategy = waitStrategy;
+    options.collectTimings = false;
+
+    AsyncQueue<uint64_t> ping(options);
+    AsyncQueue<uint64_t> pong(options);
+    auto pingHandler = std::make_shared<PingPongHandler>();
+    auto pongHandler = std::make_shared<PingPongHandler>();
+    pingHandler->peer = &pong;
+    pongHandler->peer = &ping;
+    ping.Initialize(pingHandler);
+    pong.Initialize(pongHandler);
+
+    // The token ends on the ping queue: it is processed 2 * roundTrips + 1 times in all.
+    Clock::time_point start = Clock::now();
+    ping.Push(2 * roundTrips);
+    {
+        std::unique_lock<std::mutex> lock(pingHandler->mutex);
+        pingHandler->done.wait(lock, [&pingHandler] { return pingHandler->finished; });
+    }
+    Clock::duration elapsed = Clock::now() - start;
+
+    AsyncQueueStats pingStats = ping.GetStats();
+    AsyncQueueStats pongStats = pong.GetStats();
+    ping.Uninitialize();
+    pong.Uninitialize();
+
+    RunResult result;
+    result.nanosecondsPerRoundTrip =
+        static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / roundTrips;
+    result.spinWakeCount = pingStats.spinWakeCount + pongStats.spinWakeCount;
+    result.parkCount = pingStats.parkCount + pongStats.parkCount;
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    uint64_t roundTrips = (argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000);
+
+    std::printf("%llu round trips, %u hardware threads\n",
+        static_cast<unsigned long long>(roundTrips), std::thread::hardware_concurrency());
+    std::printf("%-10s %-14s %14s %12s %12s\n", "backend", "wait", "ns/round trip", "spin wakes", "parks");
+
+    AsyncQueueBackend backends[] = { AsyncQueueBackend::Locked, AsyncQueueBackend::LockFree };
+    AsyncQueueWaitStrategy waitStrategies[] = { AsyncQueueWaitStrategy::Block, AsyncQueueWaitStrategy::SpinThenPark };
+    for (AsyncQueueBackend backend : backends)
+    {
+        for (AsyncQueueWaitStrategy waitStrategy : waitStrategies)
+        {
+            RunResult result = Run(backend, waitStrategy, roundTrips);
+            std::printf("%-10s %-14s %14.0f %12llu %12llu\n",
+                backend == AsyncQueueBackend::Locked ? "locked" : "lock-free",
+                waitStrategy == AsyncQueueWaitStrategy::Block ? "block" : "spin-then-park",
+                result.nanosecondsPerRoundTrip,
+                static_cast<unsigned long long>(result.spinWakeCount),
+                static_cast<unsigned long long>(result.parkCount));
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,284 @@
+// Compares defining many translator scripts one file at a time (read from disk, then passed to
+// DefineScriptFile) with defining them as a script bundle, uncompressed and LZ4-compressed.
+// Each run defines all the scripts, starts the engine and requires a few of them, as an app
+// does that ships many translators and uses only those for the devices it finds. It reports
+// the time to define the scripts, the time from Start to the first result, the total time, and
+// the process's resident memory (VmRSS) before and after.
+// JXCore can only be initialized once per process, so each mode runs in a child process. The
+// scripts and bundles are generated in a scratch directory first.
+//
+// Build and run on Linux from this directory, against a JXCore build:
+//   g++ -std=c++11 -O2 -I ../../src/common -I ../../src/external -o ScriptBundleBenchmark -pthread
+//       ScriptBundleBenchmark.cpp ../../src/common/Log.cpp ../../src/common/ThreadOptions.cpp
+//       ../../src/common/ScriptBundle.cpp ../../src/common/JXCoreEngine.cpp -L <jxcore>/out -ljx
+//   ./ScriptBundleBenchmark [scriptCount] [functionsPerScript] [requiredCount] [scratchDirectory]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <queue>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "Log.h"
+#include "CancellationToken.h"
+#include "NodeValue.h"
+#include "INodeEngine.h"
+#include "ThreadOptions.h"
+#include "MpscQueue.h"
+#include "RingQueue.h"
+#include "FairQueue.h"
+#include "AsyncQueue.h"
+#include "UniqueFunction.h"
+#include "WorkItemDispatcher.h"
+#include "ThreadPool.h"
+#include "LruCache.h"
+#include "SlotTable.h"
+#include "ScriptBundle.h"
+#include "JXCoreEngine.h"
+
+using namespace OpenT2T;
+
+typedef std::chrono::steady_clock Clock;
+
+// Counts down completed calls, and wakes the waiting thread when all have completed.
+class CompletionCounter
+{
+public:
+    explicit CompletionCounter(size_t count) : _remainingCount(count), _failedCount(0) { }
+
+    void Complete(std::exception_ptr ex)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (ex != nullptr)
+        {
+            _failedCount++;
+        }
+
+        if (--_remainingCount == 0)
+        {
+            _completed.notify_one();
+        }
+    }
+
+    size_t Wait()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _completed.wait(lock, [this] { return _remainingCount == 0; });
+        return _failedCount;
+    }
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _completed;
+    size_t _remainingCount;
+    size_t _failedCount;
+};
+
+void WaitForEngine(const std::function<void(std::function<void(std::exception_ptr ex)>)>& startOrStop)
+{
+    CompletionCounter counter(1);
+    startOrStop([&counter](std::exception_ptr ex) { counter.Complete(ex); });
+    if (counter.Wait() != 0)
+    {
+        std::printf("Failed to start or stop the engine.\n");
+        std::exit(1);
+    }
+}
+
+double Milliseconds(Clock::duration duration)
+{
+    return std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(duration).count();
+}
+
+// Gets the process's resident set size in KB, from /proc/self/status.
+unsigned long GetResidentKilobytes()
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.compare(0, 6, "VmRSS:") == 0)
+        {
+            return std::strtoul(line.c_str() + 6, nullptr, 10);
+        }
+    }
+    return 0;
+}
+
+std::string GetScriptName(unsigned long index)
+{
+    return "translator" + std::to_string(index) + ".js";
+}
+
+// Generates a translator script with the given number of functions, so that its size and load
+// time are like a real one's.
+std::string CreateTranslatorCode(unsigned long index, unsigned long functionCount)
+{
+    std::string code = "var states = {};\nvar deviceType = 'device" + std::to_string(index) + "';\n";
+    for (unsigned long i = 0; i < functionCount; i++)
+    {
+        std::string property = "property" + std::to_string(i);
+        code += "exports.set_" + property + " = function (value) {"
+            " states['" + property + "'] = { value: value, type: deviceType, time: Date.now() };"
+            " return JSON.stringify(states['" + property + "']); };\n";
+    }
+    code += "exports.getState = function (id) { return { id: id, type: deviceType }; };\n";
+    return code;
+}
+
+// Writes the scripts to a directory, and the two bundles next to it.
+void CreateScripts(const std::string& scratchDirectory, unsigned long scriptCount, unsigned long functionCount)
+{
+    std::string scriptDirectory = scratchDirectory + "/scripts";
+    mkdir(scratchDirectory.c_str(), 0755);
+    mkdir(scriptDirectory.c_str(), 0755);
+
+    std::vector<std::pair<std::string, std::string>> scripts;
+    for (unsigned long i = 0; i < scriptCount; i++)
+    {
+        scripts.emplace_back(GetScriptName(i), CreateTranslatorCode(i, functionCount));
+        std::ofstream file(scriptDirectory + "/" + scripts.back().first, std::ios::binary | std::ios::trunc);
+        file << scripts.back().second;
+    }
+
+    ScriptBundle::Write(scratchDirectory + "/scripts.bundle", scripts, ScriptBundleCompression::None);
+    ScriptBundle::Write(scratchDirectory + "/scripts-lz4.bundle", scripts, ScriptBundleCompression::Lz4);
+}
+
+// Runs one mode in this process, and prints its times and memory use.
+int RunMode(
+    const std::string& mode,
+    const std::string& scratchDirectory,
+    unsigned long scriptCount,
+    unsigned long requiredCount)
+{
+    unsigned long startResidentKilobytes = GetResidentKilobytes();
+    Clock::time_point constructTime = Clock::now();
+
+    JXCoreEngine engine;
+    if (mode == "files")
+    {
+        for (unsigned long i = 0; i < scriptCount; i++)
+        {
+            std::ifstream file(scratchDirectory + "/scripts/" + GetScriptName(i), std::ios::binary);
+            std::ostringstream scriptCode;
+            scriptCode << file.rdbuf();
+            engine.DefineScriptFile(GetScriptName(i), scriptCode.str());
+        }
+    }
+    else
+    {
+        engine.DefineScriptBundle(scratchDirectory + (mode == "bundle" ? "/scripts.bundle" : "/scripts-lz4.bundle"));
+    }
+
+    Clock::time_point startTime = Clock::now();
+    WaitForEngine([&engine](std::function<void(std::exception_ptr ex)> callback)
+    {
+        engine.Start(".", std::move(callback));
+    });
+
+    // Require scripts spread over the whole set, one call each, as devices are found.
+    Clock::time_point firstResultTime;
+    for (unsigned long i = 0; i < requiredCount; i++)
+    {
+        unsigned long index = (i * scriptCount) / requiredCount;
+        CompletionCounter counter(1);
+        engine.CallScript("require('" + GetScriptName(index) + "').getState('device')",
+            [&counter](std::string, std::exception_ptr ex)
+        {
+            counter.Complete(ex);
+        });
+
+        if (counter.Wait() != 0)
+        {
+            std::printf("Requiring %s failed.\n", GetScriptName(index).c_str());
+            return 1;
+        }
+
+        if (i == 0)
+        {
+            firstResultTime = Clock::now();
+        }
+    }
+
+    Clock::time_point endTime = Clock::now();
+    unsigned long endResidentKilobytes = GetResidentKilobytes();
+
+    std::printf("%-12s %10.1f %14.1f %10.1f %10lu %10lu\n", mode.c_str(),
+        Milliseconds(startTime - constructTime), Milliseconds(firstResultTime - startTime),
+        Milliseconds(endTime - constructTime), endResidentKilobytes, endResidentKilobytes - startResidentKilobytes);
+
+    WaitForEngine([&engine](std::function<void(std::exception_ptr ex)> callback)
+    {
+        engine.Stop(std::move(callback));
+    });
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc == 5 && (std::strcmp(argv[1], "files") == 0 || std::strcmp(argv[1], "bundle") == 0 ||
+        std::strcmp(argv[1], "bundle-lz4") == 0))
+    {
+        logLevel = LogSeverity::Warning;
+        return RunMode(argv[1], argv[2], std::strtoul(argv[3], nullptr, 10), std::strtoul(argv[4], nullptr, 10));
+    }
+
+    unsigned long scriptCount = (argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 300);
+    unsigned long functionCount = (argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200);
+    unsigned long requiredCount = (argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 5);
+    std::string scratchDirectory = (argc > 4 ? argv[4] : "ScriptBundleBenchmark.tmp");
+    requiredCount = std::max(1ul, std::min(requiredCount, scriptCount));
+
+    CreateScripts(scratchDirectory, scriptCount, functionCount);
+
+    struct stat bundleStat;
+    struct stat compressedBundleStat;
+    stat((scratchDirectory + "/scripts.bundle").c_str(), &bundleStat);
+    stat((scratchDirectory + "/scripts-lz4.bundle").c_str(), &compressedBundleStat);
+
+    std::printf("%lu scripts of %lu functions (bundle %lu KB, %lu KB with LZ4), %lu required\n",
+        scriptCount, functionCount, static_cast<unsigned long>(bundleStat.st_size / 1024),
+        static_cast<unsigned long>(compressedBundleStat.st_size / 1024), requiredCount);
+    std::printf("%-12s %10s %14s %10s %10s %10s\n",
+        "mode", "define ms", "start-first ms", "total ms", "RSS KB", "RSS+ KB");
+    std::fflush(stdout);
+
+    for (const char* mode : { "files", "bundle", "bundle-lz4" })
+    {
+        std::string command = std::string(argv[0]) + " " + mode + " " + scratchDirectory + " " +
+            std::to_string(scriptCount) + " " + std::to_string(requiredCount);
+        if (std::system(command.c_str()) != 0)
+        {
+            std::printf("The %s run failed.\n", mode);
+            return 1;
+        }
+    }
+
+    return 0;
+}
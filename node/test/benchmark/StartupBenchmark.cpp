@@ -0,0 +1,217 @@
+// Measures time to first result at app launch: from constructing a JXCoreEngine to the first
+// CallScript result from a translator module, with and without prewarming. The app is
+// simulated by defining a generated translator module, then doing other launch work (a sleep)
+// before starting the engine and calling the translator. A cold engine does all of its start-up
+// after the launch work; a prewarmed one starts and requires the translator during it.
+// JXCore can only be initialized once per process, so each mode runs in a child process.
+//
+// Build and run on Linux from this directory, against a JXCore build:
+//   g++ -std=c++11 -O2 -I ../../src/common -I ../../src/external -o StartupBenchmark -pthread
+//       StartupBenchmark.cpp ../../src/common/Log.cpp ../../src/common/ThreadOptions.cpp
+//       ../../src/common/ScriptBundle.cpp ../../src/common/JXCoreEngine.cpp -L <jxcore>/out -ljx
+//   ./StartupBenchmark [launchMilliseconds] [translatorFunctionCount] [runs]
+//   ./StartupBenchmark cold|prewarm [launchMilliseconds] [translatorFunctionCount]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "Log.h"
+#include "CancellationToken.h"
+#include "NodeValue.h"
+#include "INodeEngine.h"
+#include "ThreadOptions.h"
+#include "MpscQueue.h"
+#include "RingQueue.h"
+#include "FairQueue.h"
+#include "AsyncQueue.h"
+#include "UniqueFunction.h"
+#include "WorkItemDispatcher.h"
+#include "ThreadPool.h"
+#include "LruCache.h"
+#include "SlotTable.h"
+#include "JXCoreEngine.h"
+
+using namespace OpenT2T;
+
+typedef std::chrono::steady_clock Clock;
+
+// Counts down completed calls, and wakes the waiting thread when all have completed.
+class CompletionCounter
+{
+public:
+    explicit CompletionCounter(size_t count) : _remainingCount(count), _failedCount(0) { }
+
+    void Complete(std::exception_ptr ex)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (ex != nullptr)
+        {
+            _failedCount++;
+        }
+
+        if (--_remainingCount == 0)
+        {
+            _completed.notify_one();
+        }
+    }
+
+    size_t Wait()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _completed.wait(lock, [this] { return _remainingCount == 0; });
+        return _failedCount;
+    }
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _completed;
+    size_t _remainingCount;
+    size_t _failedCount;
+};
+
+void WaitForEngine(const std::function<void(std::function<void(std::exception_ptr ex)>)>& startOrStop)
+{
+    CompletionCounter counter(1);
+    startOrStop([&counter](std::exception_ptr ex) { counter.Complete(ex); });
+    if (counter.Wait() != 0)
+    {
+        std::printf("Failed to start or stop the engine.\n");
+        std::exit(1);
+    }
+}
+
+double Milliseconds(Clock::duration duration)
+{
+    return std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(duration).count();
+}
+
+// Generates a translator module with the given number of functions, so that requiring it takes
+// about as long to parse and run as a real one.
+std::string CreateTranslatorCode(unsigned long functionCount)
+{
+    std::string code = "var states = {};\n";
+    for (unsigned long i = 0; i < functionCount; i++)
+    {
+        std::string index = std::to_string(i);
+        code += "exports.setProperty" + index + " = function (value) {"
+            " states['property" + index + "'] = { value: value, time: Date.now() };"
+            " return JSON.stringify(states['property" + index + "']); };\n";
+    }
+    code += "exports.getState = function (id) { return { id: id, properties: Object.keys(states).length }; };\n";
+    return code;
+}
+
+// Runs one launch in this process, and prints its times.
+int RunMode(bool prewarm, unsigned long launchMilliseconds, unsigned long functionCount)
+{
+    std::string translatorCode = CreateTranslatorCode(functionCount);
+
+    Clock::time_point constructTime = Clock::now();
+
+    EnginePrewarmOptions prewarmOptions;
+    if (prewarm)
+    {
+        prewarmOptions.workingDirectory = ".";
+        prewarmOptions.scriptFiles.emplace("translator.js", translatorCode);
+        prewarmOptions.modules.push_back("translator.js");
+    }
+
+    JXCoreEngine engine(AsyncQueueOptions(), nullptr, ReentrantDispatchOptions(), prewarmOptions);
+    if (!prewarm)
+    {
+        engine.DefineScriptFile("translator.js", translatorCode);
+    }
+
+    // The rest of the app's launch work.
+    std::this_thread::sleep_for(std::chrono::milliseconds(launchMilliseconds));
+
+    Clock::time_point startTime = Clock::now();
+    WaitForEngine([&engine](std::function<void(std::exception_ptr ex)> callback)
+    {
+        engine.Start(".", std::move(callback));
+    });
+
+    CompletionCounter counter(1);
+    engine.CallScript("require('translator.js').getState('device')", [&counter](std::string, std::exception_ptr ex)
+    {
+        counter.Complete(ex);
+    });
+
+    if (counter.Wait() != 0)
+    {
+        std::printf("The first script call failed.\n");
+        return 1;
+    }
+
+    Clock::time_point resultTime = Clock::now();
+
+    std::printf("%-10s %16.1f %16.1f\n", (prewarm ? "prewarm" : "cold"),
+        Milliseconds(resultTime - startTime), Milliseconds(resultTime - constructTime));
+
+    WaitForEngine([&engine](std::function<void(std::exception_ptr ex)> callback)
+    {
+        engine.Stop(std::move(callback));
+    });
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1 && (std::strcmp(argv[1], "cold") == 0 || std::strcmp(argv[1], "prewarm") == 0))
+    {
+        logLevel = LogSeverity::Warning;
+        return RunMode(std::strcmp(argv[1], "prewarm") == 0,
+            (argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200),
+            (argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 2000));
+    }
+
+    unsigned long launchMilliseconds = (argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200);
+    unsigned long functionCount = (argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 2000);
+    unsigned long runCount = (argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 5);
+
+    std::printf("%lu ms of launch work, %lu translator functions, %lu runs per mode\n",
+        launchMilliseconds, functionCount, runCount);
+    std::printf("%-10s %16s %16s\n", "mode", "start-result ms", "launch-result ms");
+    std::fflush(stdout);
+
+    // Alternate the modes, so that both see the same file system cache and system load.
+    for (unsigned long run = 0; run < runCount; run++)
+    {
+        for (const char* mode : { "cold", "prewarm" })
+        {
+            std::string command = std::string(argv[0]) + " " + mode + " " +
+                std::to_string(launchMilliseconds) + " " + std::to_string(functionCount);
+            if (std::system(command.c_str()) != 0)
+            {
+                std::printf("The %s run failed.\n", mode);
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
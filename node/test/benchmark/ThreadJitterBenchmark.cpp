@@ -0,0 +1,154 @@
+// Measures wake-to-run latency of a WorkItemDispatcher's worker thread (the time from
+// dispatching an item to an idle queue until the item starts running) while every core
+// is kept busy by background threads, for several ThreadOptions configurations.
+// Real-time scheduling and negative nice values usually need root or CAP_SYS_NICE; options
+// that cannot be applied are reported as warnings and the run continues without them.
+//
+// Build and run on Linux from this directory:
+//   g++ -std=c++11 -O2 -I ../../src/common -o ThreadJitterBenchmark -pthread
+//       ThreadJitterBenchmark.cpp ../../src/common/Log.cpp ../../src/common/ThreadOptions.cpp
+//   ./ThreadJitterBenchmark [samples] [cpu]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "Log.h"
+#include "CancellationToken.h"
+#include "ThreadOptions.h"
+#include "MpscQueue.h"
+#include "RingQueue.h"
+#include "FairQueue.h"
+#include "AsyncQueue.h"
+#include "UniqueFunction.h"
+#include "WorkItemDispatcher.h"
+
+using namespace OpenT2T;
+
+typedef std::chrono::steady_clock Clock;
+
+// Keeps one core busy until stopped, with a working set large enough to disturb the caches.
+void Burn(const std::atomic<bool>& stop)
+{
+    std::vector<uint32_t> data(256 * 1024);
+    uint32_t value = 1;
+    while (!stop.load(std::memory_order_relaxed))
+    {
+        for (size_t i = 0; i < data.size(); i += 16)
+        {
+            value = value * 1664525 + 1013904223;
+            data[i] += value;
+        }
+    }
+}
+
+std::vector<uint64_t> Measure(const ThreadOptions& threadOptions, size_t sampleCount)
+{
+    AsyncQueueOptions options;
+    options.threadOptions = threadOptions;
+    WorkItemDispatcher dispatcher(options);
+    dispatcher.Initialize();
+
+    std::vector<uint64_t> latencies(sampleCount);
+    for (size_t i = 0; i < sampleCount; i++)
+    {
+        // Let the worker go idle so each sample includes waking it up.
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        Clock::time_point dispatchTime = Clock::now();
+        dispatcher.DispatchAndWait([&latencies, i, dispatchTime]()
+        {
+            latencies[i] = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - dispatchTime).count());
+        });
+    }
+
+    dispatcher.Shutdown();
+    std::sort(latencies.begin(), latencies.end());
+    return latencies;
+}
+
+uint64_t Percentile(const std::vector<uint64_t>& sorted, double percentile)
+{
+    size_t index = static_cast<size_t>(percentile / 100.0 * (sorted.size() - 1));
+    return sorted[index];
+}
+
+int main(int argc, char** argv)
+{
+    size_t sampleCount = (argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000);
+    unsigned int coreCount = std::max(1u, std::thread::hardware_concurrency());
+    unsigned int cpu = (argc > 2 ? static_cast<unsigned int>(std::strtoul(argv[2], nullptr, 10)) : coreCount - 1);
+
+    logLevel = LogSeverity::Warning;
+    logHandler = [](LogSeverity, const char* message)
+    {
+        std::printf("  warning: %s\n", message);
+    };
+
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> burners;
+    for (unsigned int i = 0; i < coreCount; i++)
+    {
+        burners.emplace_back(Burn, std::cref(stop));
+    }
+
+    struct Configuration
+    {
+        const char* name;
+        ThreadOptions options;
+    };
+
+    std::vector<Configuration> configurations(4);
+    configurations[0].name = "default";
+    configurations[1].name = "pinned";
+    configurations[1].options.cpuAffinity.push_back(cpu);
+    configurations[2].name = "pinned, nice -10";
+    configurations[2].options.cpuAffinity.push_back(cpu);
+    configurations[2].options.priority = -10;
+    configurations[3].name = "pinned, SCHED_FIFO 10";
+    configurations[3].options.cpuAffinity.push_back(cpu);
+    configurations[3].options.schedulingPolicy = ThreadSchedulingPolicy::Fifo;
+    configurations[3].options.priority = 10;
+
+    std::printf("%u background threads, %u samples, pinned to CPU %u\n",
+        coreCount, static_cast<unsigned int>(sampleCount), cpu);
+    std::printf("%-22s %10s %10s %10s %10s\n", "configuration", "p50 us", "p99 us", "p99.9 us", "max us");
+
+    for (Configuration& configuration : configurations)
+    {
+        configuration.options.name = "JitterWorker";
+        std::vector<uint64_t> latencies = Measure(configuration.options, sampleCount);
+        std::printf("%-22s %10llu %10llu %10llu %10llu\n",
+            configuration.name,
+            static_cast<unsigned long long>(Percentile(latencies, 50)),
+            static_cast<unsigned long long>(Percentile(latencies, 99)),
+            static_cast<unsigned long long>(Percentile(latencies, 99.9)),
+            static_cast<unsigned long long>(latencies.back()));
+    }
+
+    stop.store(true);
+    for (std::thread& burner : burners)
+    {
+        burner.join();
+    }
+
+    return 0;
+}
@@ -0,0 +1,140 @@
+// Creates a script bundle (see ScriptBundle.h) from a directory of script files, for an app to
+// define with INodeEngine::DefineScriptBundle instead of defining each file. Each file's script
+// name is its path relative to the directory, with '/' separators, so a file "translator.js"
+// is required as require('translator.js'). With --lz4 scripts are LZ4-compressed, except any
+// that do not get smaller. With --list the entries of an existing bundle are listed.
+//
+// Build and run on Linux or macOS from this directory:
+//   g++ -std=c++11 -O2 -I ../src/common -o MakeScriptBundle
+//       MakeScriptBundle.cpp ../src/common/Log.cpp ../src/common/ScriptBundle.cpp
+//   ./MakeScriptBundle [--lz4] <bundleFile> <scriptDirectory>
+//   ./MakeScriptBundle --list <bundleFile>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "Log.h"
+#include "ScriptBundle.h"
+
+using namespace OpenT2T;
+
+// Adds the files under a directory to the scripts, named by their paths relative to the root.
+void AddScripts(
+    const std::string& directory,
+    const std::string& namePrefix,
+    std::vector<std::pair<std::string, std::string>>& scripts)
+{
+    DIR* dir = opendir(directory.c_str());
+    if (dir == nullptr)
+    {
+        throw std::runtime_error("Cannot open directory '" + directory + "'.");
+    }
+
+    std::vector<std::string> entryNames;
+    for (dirent* entry = readdir(dir); entry != nullptr; entry = readdir(dir))
+    {
+        if (std::strcmp(entry->d_name, ".") != 0 && std::strcmp(entry->d_name, "..") != 0)
+        {
+            entryNames.push_back(entry->d_name);
+        }
+    }
+    closedir(dir);
+
+    // Sort the entries, so that the same directory always makes the same bundle.
+    std::sort(entryNames.begin(), entryNames.end());
+
+    for (const std::string& entryName : entryNames)
+    {
+        std::string path = directory + "/" + entryName;
+        struct stat pathStat;
+        if (stat(path.c_str(), &pathStat) != 0)
+        {
+            throw std::runtime_error("Cannot read '" + path + "'.");
+        }
+
+        if (S_ISDIR(pathStat.st_mode))
+        {
+            AddScripts(path, namePrefix + entryName + "/", scripts);
+        }
+        else if (S_ISREG(pathStat.st_mode))
+        {
+            std::ifstream file(path, std::ios::binary);
+            std::ostringstream scriptCode;
+            scriptCode << file.rdbuf();
+            if (!file)
+            {
+                throw std::runtime_error("Cannot read '" + path + "'.");
+            }
+
+            scripts.emplace_back(namePrefix + entryName, scriptCode.str());
+        }
+    }
+}
+
+int List(const std::string& bundlePath)
+{
+    ScriptBundle bundle(bundlePath);
+    size_t storedSize = 0;
+    size_t size = 0;
+    std::printf("%12s %12s  %s\n", "stored", "size", "name");
+    for (const ScriptBundleEntry& entry : bundle.GetEntries())
+    {
+        std::printf("%12u %12u  %s\n", entry.storedSize, entry.size, entry.name.c_str());
+        storedSize += entry.storedSize;
+        size += entry.size;
+    }
+
+    std::printf("%12u %12u  %u scripts\n", static_cast<unsigned int>(storedSize), static_cast<unsigned int>(size),
+        static_cast<unsigned int>(bundle.GetEntries().size()));
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        if (argc == 3 && std::strcmp(argv[1], "--list") == 0)
+        {
+            return List(argv[2]);
+        }
+
+        bool compress = (argc == 4 && std::strcmp(argv[1], "--lz4") == 0);
+        if (argc != 3 && !compress)
+        {
+            std::fprintf(stderr, "Usage: MakeScriptBundle [--lz4] <bundleFile> <scriptDirectory>\n"
+                "       MakeScriptBundle --list <bundleFile>\n");
+            return 2;
+        }
+
+        std::string bundlePath = argv[argc - 2];
+        std::string scriptDirectory = argv[argc - 1];
+
+        std::vector<std::pair<std::string, std::string>> scripts;
+        AddScripts(scriptDirectory, "", scripts);
+        ScriptBundle::Write(bundlePath, scripts,
+            (compress ? ScriptBundleCompression::Lz4 : ScriptBundleCompression::None));
+
+        std::printf("Wrote %u scripts to %s.\n", static_cast<unsigned int>(scripts.size()), bundlePath.c_str());
+        return 0;
+    }
+    catch (const std::exception& ex)
+    {
+        std::fprintf(stderr, "%s\n", ex.what());
+        return 1;
+    }
+}